@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Number of heap allocations made so far by the whole process, implemented by replacing the global operator new
+uint64_t GetAllocationCount();
+
+struct sBenchmarkResult
+{
+	std::string Name;
+	uint64_t Iterations = 0;
+	double Seconds = 0.0;			// total time of all the iterations
+	uint64_t BytesPerIteration = 0;	// 0 if the throughput in bytes doesn't apply
+	uint64_t ItemsPerIteration = 0;	// 0 if the throughput in items doesn't apply
+	uint64_t Allocations = 0;		// heap allocations of all the iterations
+
+	inline double NanosecondsPerIteration() const { return Iterations > 0 ? Seconds * 1e9 / Iterations : 0.0; }
+	inline double BytesPerSecond() const { return Seconds > 0.0 ? BytesPerIteration * Iterations / Seconds : 0.0; }
+	inline double ItemsPerSecond() const { return Seconds > 0.0 ? ItemsPerIteration * Iterations / Seconds : 0.0; }
+	inline double AllocationsPerIteration() const { return Iterations > 0 ? static_cast<double>(Allocations) / Iterations : 0.0; }
+};
+
+// Runs each benchmark repeatedly until it takes at least the minimum time
+class CBenchmarkRunner
+{
+private:
+	double mMinTime;
+	std::string mFilter;
+	std::vector<sBenchmarkResult> mResults;
+	volatile uint64_t mSink = 0; // results of the benchmarks, so their work is not optimized away
+
+public:
+	// filter: if not empty, only the benchmarks whose name contains it run
+	CBenchmarkRunner(double minTime, const std::string& filter)
+		: mMinTime(minTime), mFilter(filter)
+	{
+	}
+
+	// fn: returns a value derived from its work, so the compiler cannot remove it
+	template<typename Fn>
+	void Run(const std::string& name, uint64_t bytesPerIteration, uint64_t itemsPerIteration, Fn&& fn)
+	{
+		if (!mFilter.empty() && name.find(mFilter) == std::string::npos)
+		{
+			return;
+		}
+
+		using tClock = std::chrono::steady_clock;
+
+		mSink += fn(); // warm up
+
+		uint64_t iterations = 1;
+		double seconds = 0.0;
+		uint64_t allocations = 0;
+		for (;;)
+		{
+			const uint64_t startAllocations = GetAllocationCount();
+			const auto start = tClock::now();
+			for (uint64_t i = 0; i < iterations; i++)
+			{
+				mSink += fn();
+			}
+			seconds = std::chrono::duration<double>(tClock::now() - start).count();
+			allocations = GetAllocationCount() - startAllocations;
+
+			if (seconds >= mMinTime)
+			{
+				break;
+			}
+
+			// aim a bit above the minimum time, growing at most 10x per round in case the first rounds were noisy
+			const double target = seconds > 0.0 ? std::ceil(iterations * mMinTime * 1.2 / seconds) : iterations * 10.0;
+			iterations = std::max<uint64_t>(iterations + 1, std::min<uint64_t>(iterations * 10, static_cast<uint64_t>(target)));
+		}
+
+		sBenchmarkResult& r = mResults.emplace_back();
+		r.Name = name;
+		r.Iterations = iterations;
+		r.Seconds = seconds;
+		r.BytesPerIteration = bytesPerIteration;
+		r.ItemsPerIteration = itemsPerIteration;
+		r.Allocations = allocations;
+	}
+
+	inline const std::vector<sBenchmarkResult>& Results() const { return mResults; }
+};
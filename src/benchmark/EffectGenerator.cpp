@@ -0,0 +1,233 @@
+#include "EffectGenerator.h"
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include "Hash.h"
+
+static void CheckLimit(uint32_t value, uint32_t max, const char* what)
+{
+	if (value > max)
+	{
+		throw std::invalid_argument(std::string("Too many ") + what + " (" + std::to_string(value) + "), the limit is " + std::to_string(max));
+	}
+}
+
+CEffectGenerator::CEffectGenerator(const sEffectGeneratorOptions& options)
+	: mOptions(options)
+{
+	CheckLimit(mOptions.NumTechniques, MaxTechniques, "techniques");
+	CheckLimit(mOptions.PassesPerTechnique, MaxPassesPerTechnique, "passes per technique");
+	CheckLimit(mOptions.NumPrograms, MaxProgramsPerType, "programs");
+	CheckLimit(mOptions.NumSharedBuffers, MaxBuffers, "shared buffers");
+	CheckLimit(mOptions.NumLocalBuffers, MaxBuffers, "local buffers");
+	// shared buffers variables are saved as global variables, local buffers variables and samplers as local variables
+	CheckLimit(mOptions.NumSharedBuffers * mOptions.VariablesPerBuffer, MaxVariables, "shared variables");
+	CheckLimit(mOptions.NumLocalBuffers * mOptions.VariablesPerBuffer + mOptions.NumSamplers, MaxVariables, "local variables and samplers");
+
+	if (mOptions.NumPrograms == 0 && mOptions.NumTechniques > 0 && mOptions.PassesPerTechnique > 0)
+	{
+		throw std::invalid_argument("The passes require at least one program");
+	}
+}
+
+std::string CEffectGenerator::GenerateSource() const
+{
+	std::ostringstream s;
+
+	s << "// Synthetic effect, seed " << mOptions.Seed << "\n\n";
+
+	for (uint32_t i = 0; i < mOptions.NumSharedBuffers; i++)
+	{
+		const std::string name = SharedBufferName(i);
+		s << "shared cbuffer " << name << " : register(b" << i << ")\n{\n";
+		for (uint32_t j = 0; j < mOptions.VariablesPerBuffer; j++)
+		{
+			s << "\tfloat4 " << VariableName(name, j) << ";\n";
+		}
+		s << "}\n\n";
+	}
+
+	for (uint32_t i = 0; i < mOptions.NumLocalBuffers; i++)
+	{
+		const std::string name = LocalBufferName(i);
+		s << "cbuffer " << name << " : register(b" << (mOptions.NumSharedBuffers + i) << ")\n{\n";
+		for (uint32_t j = 0; j < mOptions.VariablesPerBuffer; j++)
+		{
+			s << "\tfloat4 " << VariableName(name, j) << ";\n";
+		}
+		s << "}\n\n";
+	}
+
+	const auto& samplerAssignments = SamplerStateAssignments();
+	for (uint32_t i = 0; i < mOptions.NumSamplers; i++)
+	{
+		s << "SamplerState " << SamplerName(i) << " : register(s" << i << ")\n{\n";
+		for (size_t j = 0; j < 3; j++)
+		{
+			const auto& a = samplerAssignments[(i + j * 5) % samplerAssignments.size()];
+			s << "\t" << a.first << " = " << a.second << ";\n";
+		}
+		s << "};\n\n";
+	}
+
+	for (uint32_t i = 0; i < mOptions.NumPrograms; i++)
+	{
+		s << "/* vertex program " << i << " */\n";
+		s << "float4 " << VertexProgramName(i) << "(float4 pos : POSITION) : SV_Position\n{\n";
+		s << "\treturn pos;\n";
+		s << "}\n\n";
+
+		s << "// fragment program " << i << "\n";
+		s << "float4 " << FragmentProgramName(i) << "(float2 uv : TEXCOORD0) : SV_Target\n{\n";
+		if (mOptions.NumSamplers > 0)
+		{
+			s << "\treturn tex2D(" << SamplerName(i % mOptions.NumSamplers) << ", uv);\n";
+		}
+		else
+		{
+			s << "\treturn float4(uv, 0.0, 1.0);\n";
+		}
+		s << "}\n\n";
+	}
+
+	const auto& passAssignments = TechniquePassAssignments();
+	const char* vertexAssignment = CEffect::GetAssignmentTypeForProgram(eProgramType::Vertex);
+	const char* fragmentAssignment = CEffect::GetAssignmentTypeForProgram(eProgramType::Fragment);
+	for (uint32_t i = 0; i < mOptions.NumTechniques; i++)
+	{
+		s << "technique technique_" << i << "\n{\n";
+		for (uint32_t j = 0; j < mOptions.PassesPerTechnique; j++)
+		{
+			const uint32_t program = (i * mOptions.PassesPerTechnique + j) % mOptions.NumPrograms;
+
+			s << "\tpass\n\t{\n";
+			s << "\t\t" << vertexAssignment << " = " << VertexProgramName(program) << ";\n";
+			s << "\t\t" << fragmentAssignment << " = " << FragmentProgramName(program) << ";\n";
+			for (size_t k = 0; k < 4; k++)
+			{
+				const auto& a = passAssignments[(i + j + k * 4) % passAssignments.size()];
+				s << "\t\t" << a.first << " = " << a.second << ";\n";
+			}
+			s << "\t}\n";
+		}
+		s << "}\n\n";
+	}
+
+	return s.str();
+}
+
+void CEffectGenerator::InjectPrograms(CEffect& fx) const
+{
+	for (uint32_t i = 0; i < mOptions.NumPrograms; i++)
+	{
+		for (eProgramType type : { eProgramType::Vertex, eProgramType::Fragment })
+		{
+			std::mt19937 rng(mOptions.Seed ^ (i * 2 + static_cast<uint32_t>(type)));
+			std::vector<uint8_t> code(mOptions.ProgramSize);
+			for (auto& b : code)
+			{
+				b = static_cast<uint8_t>(rng());
+			}
+
+			auto blob = std::make_unique<CCodeBlob>(code.data(), static_cast<uint32_t>(code.size()));
+			blob->SetReflection(GenerateReflection(i));
+			fx.SetProgramCode(type == eProgramType::Vertex ? VertexProgramName(i) : FragmentProgramName(i), std::move(blob));
+		}
+	}
+}
+
+sProgramReflection CEffectGenerator::GenerateReflection(uint32_t programIndex) const
+{
+	sProgramReflection r;
+
+	auto addBuffer = [this, &r](const std::string& name, uint32_t reg)
+	{
+		const uint32_t bufferIndex = static_cast<uint32_t>(r.Buffers.size());
+
+		sReflectedBuffer& b = r.Buffers.emplace_back();
+		b.Name = name;
+		b.NameHash = joaat(name);
+		b.Size = mOptions.VariablesPerBuffer * 16;
+		b.Register = reg;
+
+		for (uint32_t j = 0; j < mOptions.VariablesPerBuffer; j++)
+		{
+			sReflectedVariable& v = r.Variables.emplace_back();
+			v.Name = VariableName(name, j);
+			v.BufferIndex = bufferIndex;
+			v.Offset = j * 16;
+			v.Count = 0;
+			v.Type = 5; // float4
+		}
+	};
+
+	if (mOptions.NumSharedBuffers > 0)
+	{
+		const uint32_t index = programIndex % mOptions.NumSharedBuffers;
+		addBuffer(SharedBufferName(index), index);
+	}
+
+	if (mOptions.NumLocalBuffers > 0)
+	{
+		const uint32_t index = programIndex % mOptions.NumLocalBuffers;
+		addBuffer(LocalBufferName(index), mOptions.NumSharedBuffers + index);
+	}
+
+	if (mOptions.NumSamplers > 0)
+	{
+		const uint32_t index = programIndex % mOptions.NumSamplers;
+
+		sReflectedResource& res = r.Resources.emplace_back();
+		res.Name = SamplerName(index);
+		res.BindPoint = index;
+		res.IsTexture = false;
+	}
+
+	return r;
+}
+
+const std::vector<std::pair<std::string, std::string>>& CEffectGenerator::TechniquePassAssignments()
+{
+	static const std::vector<std::pair<std::string, std::string>> assignments =
+	{
+		{ "CullMode",				"BACK" },
+		{ "FillMode",				"SOLID" },
+		{ "DepthEnable",			"TRUE" },
+		{ "DepthWriteMask",			"ALL" },
+		{ "DepthFunc",				"LESS_EQUAL" },
+		{ "StencilEnable",			"FALSE" },
+		{ "StencilReadMask",		"255" },
+		{ "StencilWriteMask",		"0xFF" },
+		{ "FrontFaceStencilFunc",	"ALWAYS" },
+		{ "FrontFaceStencilPass",	"REPLACE" },
+		{ "AlphaToCoverageEnable",	"FALSE" },
+		{ "BlendEnable0",			"TRUE" },
+		{ "SrcBlend0",				"SRC_ALPHA" },
+		{ "DestBlend0",				"INV_SRC_ALPHA" },
+		{ "BlendOp0",				"ADD" },
+		{ "RenderTargetWriteMask0",	"15" },
+	};
+	return assignments;
+}
+
+const std::vector<std::pair<std::string, std::string>>& CEffectGenerator::SamplerStateAssignments()
+{
+	static const std::vector<std::pair<std::string, std::string>> assignments =
+	{
+		{ "AddressU", "WRAP" },
+		{ "AddressV", "CLAMP" },
+		{ "AddressW", "MIRROR" },
+		{ "AddressU", "BORDER" },
+		{ "AddressV", "MIRROR_ONCE" },
+		{ "AddressW", "WRAP" },
+		{ "AddressU", "CLAMP" },
+	};
+	return assignments;
+}
+
+std::string CEffectGenerator::VertexProgramName(uint32_t index) { return "VS_" + std::to_string(index); }
+std::string CEffectGenerator::FragmentProgramName(uint32_t index) { return "PS_" + std::to_string(index); }
+std::string CEffectGenerator::SharedBufferName(uint32_t index) { return "shared_buffer_" + std::to_string(index); }
+std::string CEffectGenerator::LocalBufferName(uint32_t index) { return "local_buffer_" + std::to_string(index); }
+std::string CEffectGenerator::VariableName(const std::string& bufferName, uint32_t index) { return bufferName + "_var_" + std::to_string(index); }
+std::string CEffectGenerator::SamplerName(uint32_t index) { return "sampler_" + std::to_string(index); }
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Effect.h"
+
+// Limits of the .fxc format, counts are stored in a single byte
+static constexpr uint32_t MaxTechniques = 255;
+static constexpr uint32_t MaxPassesPerTechnique = 255;
+static constexpr uint32_t MaxProgramsPerType = 254; // index 0 is the NULL program
+static constexpr uint32_t MaxBuffers = 255;
+static constexpr uint32_t MaxVariables = 255;
+
+struct sEffectGeneratorOptions
+{
+	uint32_t NumTechniques = 64;
+	uint32_t PassesPerTechnique = 4;
+	uint32_t NumPrograms = 64;			// per program type, only vertex and fragment programs are generated
+	uint32_t NumSamplers = 32;
+	uint32_t NumSharedBuffers = 8;
+	uint32_t NumLocalBuffers = 8;
+	uint32_t VariablesPerBuffer = 16;
+	uint32_t ProgramSize = 2048;		// size of the fake bytecode, in bytes
+	uint32_t Seed = 1;
+};
+
+// Generates synthetic effects that exercise the parser and the saver without the D3D compiler
+class CEffectGenerator
+{
+private:
+	sEffectGeneratorOptions mOptions;
+
+public:
+	// Throws if the options exceed the limits of the .fxc format
+	CEffectGenerator(const sEffectGeneratorOptions& options);
+
+	// Source of the effect, already preprocessed. The HLSL functions are placeholders, only the
+	// techniques, sampler states and shared variables are meant to be parsed.
+	std::string GenerateSource() const;
+	// Sets up an effect created from GenerateSource with fake code and reflection for every
+	// program, as if EnsureProgramsReflection ran
+	void InjectPrograms(CEffect& fx) const;
+
+	// (type, value) pairs of the assignments used in the generated passes and sampler states
+	static const std::vector<std::pair<std::string, std::string>>& TechniquePassAssignments();
+	static const std::vector<std::pair<std::string, std::string>>& SamplerStateAssignments();
+
+	inline const sEffectGeneratorOptions& Options() const { return mOptions; }
+
+private:
+	sProgramReflection GenerateReflection(uint32_t programIndex) const;
+
+	static std::string VertexProgramName(uint32_t index);
+	static std::string FragmentProgramName(uint32_t index);
+	static std::string SharedBufferName(uint32_t index);
+	static std::string LocalBufferName(uint32_t index);
+	static std::string VariableName(const std::string& bufferName, uint32_t index);
+	static std::string SamplerName(uint32_t index);
+};
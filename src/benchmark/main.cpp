@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <filesystem>
+#include <tclap/CmdLine.h>
+#include "Benchmark.h"
+#include "EffectGenerator.h"
+#include "Effect.h"
+#include "EffectLoader.h"
+#include "EffectParser.h"
+#include "EffectSaver.h"
+#include "EffectScanner.h"
+#include "Hash.h"
+#include "Parallel.h"
+
+static std::atomic<uint64_t> gAllocationCount{ 0 };
+
+// Counts the allocations of the benchmarks. The array and nothrow forms of new call this one by default,
+// the aligned forms are not counted.
+void* operator new(std::size_t size)
+{
+	gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size != 0 ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t /* size */) noexcept
+{
+	std::free(p);
+}
+
+uint64_t GetAllocationCount()
+{
+	return gAllocationCount.load(std::memory_order_relaxed);
+}
+
+static void WriteJson(std::ostream& out, const sEffectGeneratorOptions& options, size_t sourceSize, const std::vector<sBenchmarkResult>& results)
+{
+	out << "{\n";
+	out << "  \"effect\": {\n";
+	out << "    \"techniques\": " << options.NumTechniques << ",\n";
+	out << "    \"passes_per_technique\": " << options.PassesPerTechnique << ",\n";
+	out << "    \"programs\": " << options.NumPrograms << ",\n";
+	out << "    \"samplers\": " << options.NumSamplers << ",\n";
+	out << "    \"shared_buffers\": " << options.NumSharedBuffers << ",\n";
+	out << "    \"local_buffers\": " << options.NumLocalBuffers << ",\n";
+	out << "    \"variables_per_buffer\": " << options.VariablesPerBuffer << ",\n";
+	out << "    \"program_size\": " << options.ProgramSize << ",\n";
+	out << "    \"seed\": " << options.Seed << ",\n";
+	out << "    \"source_size\": " << sourceSize << "\n";
+	out << "  },\n";
+	out << "  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const sBenchmarkResult& r = results[i];
+		// the names are generated by this program, they don't need escaping
+		out << (i == 0 ? "\n" : ",\n");
+		out << "    { \"name\": \"" << r.Name << "\"";
+		out << ", \"iterations\": " << r.Iterations;
+		out << ", \"seconds\": " << r.Seconds;
+		out << ", \"ns_per_iteration\": " << r.NanosecondsPerIteration();
+		out << ", \"bytes_per_second\": " << r.BytesPerSecond();
+		out << ", \"items_per_second\": " << r.ItemsPerSecond();
+		out << ", \"allocations_per_iteration\": " << r.AllocationsPerIteration();
+		out << " }";
+	}
+	out << "\n  ]\n";
+	out << "}\n";
+}
+
+static void WriteTable(std::ostream& out, const std::vector<sBenchmarkResult>& results)
+{
+	const auto flags = out.flags();
+	const auto precision = out.precision();
+
+	out << std::left << std::setw(36) << "benchmark"
+		<< std::right << std::setw(14) << "iterations"
+		<< std::setw(16) << "ns/iteration"
+		<< std::setw(12) << "MB/s"
+		<< std::setw(16) << "items/s"
+		<< std::setw(14) << "allocs/iter" << "\n";
+	out << std::fixed;
+	for (const auto& r : results)
+	{
+		out << std::left << std::setw(36) << r.Name
+			<< std::right << std::setw(14) << r.Iterations
+			<< std::setw(16) << std::setprecision(1) << r.NanosecondsPerIteration()
+			<< std::setw(12) << std::setprecision(1) << r.BytesPerSecond() / (1024.0 * 1024.0)
+			<< std::setw(16) << std::setprecision(0) << r.ItemsPerSecond()
+			<< std::setw(14) << std::setprecision(1) << r.AllocationsPerIteration() << "\n";
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+// Loads the saved effect back and checks that it has the techniques and programs of `fx`, so the
+// benchmarks of the saver and the loader also verify that their formats agree
+static void CheckRoundTrip(const CEffect& fx, const std::vector<uint8_t>& fxc)
+{
+	auto check = [](bool condition, const std::string& what)
+	{
+		if (!condition)
+		{
+			throw std::runtime_error("Round trip of the saved effect failed: " + what);
+		}
+	};
+
+	const CEffectLoader loader(fxc.data(), fxc.size());
+
+	// only vertex and fragment programs are saved, the other types only have the NULL program
+	for (size_t type = 0; type < static_cast<size_t>(eProgramType::NumberOfTypes); type++)
+	{
+		const std::vector<std::string_view>& programs = fx.Programs(static_cast<eProgramType>(type));
+		const std::vector<sLoadedProgram>& loaded = loader.Programs(type);
+		const bool saved = type == static_cast<size_t>(eProgramType::Vertex) || type == static_cast<size_t>(eProgramType::Fragment);
+		check(loaded.size() == (saved ? programs.size() : 0) + 1, "number of programs");
+		check(loaded[0].Name == CEffect::NullProgramName && loaded[0].Code.empty(), "NULL program");
+		for (size_t i = 0; saved && i < programs.size(); i++)
+		{
+			const CCodeBlob& code = fx.GetProgramCode(std::string(programs[i]));
+			check(loaded[i + 1].Name == programs[i], "name of program '" + std::string(programs[i]) + "'");
+			check(loaded[i + 1].Code == std::string_view(reinterpret_cast<const char*>(code.Data()), code.Size()), "code of program '" + std::string(programs[i]) + "'");
+		}
+	}
+
+	check(loader.Techniques().size() == fx.Techniques().size(), "number of techniques");
+	for (size_t t = 0; t < fx.Techniques().size(); t++)
+	{
+		const sTechnique& technique = fx.Techniques()[t];
+		const sLoadedTechnique& loaded = loader.Techniques()[t];
+		check(loaded.Name == technique.Name && loaded.Passes.size() == technique.Passes.size(), "technique '" + std::string(technique.Name) + "'");
+		for (size_t p = 0; p < technique.Passes.size(); p++)
+		{
+			check(std::equal(std::begin(technique.Passes[p].Programs), std::end(technique.Passes[p].Programs), std::begin(loaded.Passes[p].Programs)) &&
+				  loaded.Passes[p].Assignments.size() == technique.Passes[p].Assignments.size(), "pass " + std::to_string(p) + " of technique '" + std::string(technique.Name) + "'");
+		}
+	}
+}
+
+static void RunBenchmarks(CBenchmarkRunner& runner, const CEffectGenerator& generator, const std::string& source)
+{
+	// joaat
+	{
+		CEffect fx(source, "synthetic.fx", {});
+		fx.SetPreprocessedSource(source);
+		generator.InjectPrograms(fx);
+
+		// names hashed by the saver: buffers, variables and samplers
+		std::vector<std::string> names;
+		uint64_t namesSize = 0;
+		fx.EnsureTechniques();
+		for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
+		{
+			for (std::string_view e : fx.Programs(static_cast<eProgramType>(i)))
+			{
+				const sProgramReflection& r = fx.GetProgramCode(std::string(e)).Reflection();
+				for (const auto& b : r.Buffers) { names.push_back(b.Name); }
+				for (const auto& v : r.Variables) { names.push_back(v.Name); }
+				for (const auto& res : r.Resources) { names.push_back(res.Name); }
+			}
+		}
+		for (const auto& n : names)
+		{
+			namesSize += n.size();
+		}
+
+		runner.Run("joaat/names", namesSize, names.size(), [&names]()
+		{
+			uint64_t r = 0;
+			for (const auto& n : names)
+			{
+				r += joaat(n);
+			}
+			return r;
+		});
+
+		runner.Run("joaat/source", source.size(), 1, [&source]()
+		{
+			return static_cast<uint64_t>(joaat(source));
+		});
+
+		// the same names hashed in batches
+		const std::vector<std::string_view> namesViews(names.begin(), names.end());
+		std::vector<uint32_t> hashes(names.size());
+		for (auto kernel : { eJoaatKernel::Scalar, eJoaatKernel::SSE2, eJoaatKernel::AVX2 })
+		{
+			if (!IsJoaatKernelSupported(kernel))
+			{
+				continue;
+			}
+
+			runner.Run(std::string("joaat/names_many/") + GetJoaatKernelName(kernel), namesSize, names.size(), [&namesViews, &hashes, kernel]()
+			{
+				joaat_many(namesViews.data(), hashes.data(), namesViews.size(), kernel);
+
+				uint64_t r = 0;
+				for (uint32_t h : hashes)
+				{
+					r += h;
+				}
+				return r;
+			});
+		}
+	}
+
+	// scanner kernels, number of candidate positions in the source
+	for (auto kernel : { CEffectScanner::eKernel::Scalar, CEffectScanner::eKernel::SSE2, CEffectScanner::eKernel::AVX2 })
+	{
+		if (!CEffectScanner::IsSupported(kernel))
+		{
+			continue;
+		}
+
+		CEffectScanner scanner(source, kernel);
+		runner.Run(std::string("scan/") + CEffectScanner::GetKernelName(kernel), source.size(), 1, [&scanner, &source]()
+		{
+			uint64_t r = 0;
+			const char* end = source.data() + source.size();
+			for (const char* p = scanner.Next(source.data()); p < end; p = scanner.Next(p + 1))
+			{
+				r++;
+			}
+			return r;
+		});
+	}
+
+	// parser
+	{
+		CEffectParser parser(source);
+		runner.Run("parse/effect_grammar", source.size(), 1, [&parser]()
+		{
+			return static_cast<uint64_t>(parser.Parse().Techniques.size());
+		});
+		runner.Run("parse/effect_grammar_parallel", source.size(), 1, [&parser]()
+		{
+			return static_cast<uint64_t>(parser.Parse(DefaultNumberOfJobs()).Techniques.size());
+		});
+		runner.Run("parse/effect", source.size(), 1, [&source]()
+		{
+			CEffect fx(source, "synthetic.fx", {});
+			fx.SetPreprocessedSource(source);
+			fx.EnsureTechniques();
+			return static_cast<uint64_t>(fx.Techniques().size());
+		});
+	}
+
+	// assignments lookup
+	{
+		const auto& passAssignments = CEffectGenerator::TechniquePassAssignments();
+		runner.Run("assignment/technique_pass", 0, passAssignments.size(), [&passAssignments]()
+		{
+			uint64_t r = 0;
+			for (const auto& a : passAssignments)
+			{
+				r += sAssignment::GetTechniquePassAssignment(a.first, a.second).Value;
+			}
+			return r;
+		});
+
+		const auto& samplerAssignments = CEffectGenerator::SamplerStateAssignments();
+		runner.Run("assignment/sampler_state", 0, samplerAssignments.size(), [&samplerAssignments]()
+		{
+			uint64_t r = 0;
+			for (const auto& a : samplerAssignments)
+			{
+				r += sAssignment::GetSamplerStateAssignment(a.first, a.second).Value;
+			}
+			return r;
+		});
+	}
+
+	// saver and loader, with the programs code and reflection already available
+	{
+		CEffect fx(source, "synthetic.fx", {});
+		fx.SetPreprocessedSource(source);
+		generator.InjectPrograms(fx);
+		fx.EnsureProgramsReflection();
+
+		CEffectSaver saver(fx);
+		const std::vector<uint8_t> fxc = saver.SaveToMemory();
+		CheckRoundTrip(fx, fxc);
+
+		runner.Run("save/save_to_memory", fxc.size(), 1, [&saver]()
+		{
+			return static_cast<uint64_t>(saver.SaveToMemory().size());
+		});
+		runner.Run("load/load_from_memory", fxc.size(), 1, [&fxc]()
+		{
+			return static_cast<uint64_t>(CEffectLoader(fxc.data(), fxc.size()).Techniques().size());
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const sEffectGeneratorOptions defaults;
+
+		TCLAP::CmdLine cmd("Benchmarks of the shader effect compiler on synthetic effects", ' ', "WIP");
+		TCLAP::ValueArg<std::filesystem::path> outputArg("o", "output", "Writes the results to a file in JSON format.", false, "", "file");
+		TCLAP::ValueArg<std::filesystem::path> generateArg("g", "generate", "Only writes the synthetic effect source to a file, without running the benchmarks.", false, "", "file");
+		TCLAP::ValueArg<std::string> filterArg("f", "filter", "Only runs the benchmarks whose name contains this text.", false, "", "text");
+		TCLAP::ValueArg<double> minTimeArg("", "min_time", "Specifies the minimum time each benchmark runs for, in seconds.", false, 0.5, "seconds");
+		TCLAP::ValueArg<uint32_t> techniquesArg("", "techniques", "Specifies the number of techniques of the synthetic effect.", false, defaults.NumTechniques, "count");
+		TCLAP::ValueArg<uint32_t> passesArg("", "passes", "Specifies the number of passes per technique.", false, defaults.PassesPerTechnique, "count");
+		TCLAP::ValueArg<uint32_t> programsArg("", "programs", "Specifies the number of vertex and fragment programs.", false, defaults.NumPrograms, "count");
+		TCLAP::ValueArg<uint32_t> samplersArg("", "samplers", "Specifies the number of sampler states.", false, defaults.NumSamplers, "count");
+		TCLAP::ValueArg<uint32_t> sharedBuffersArg("", "shared_buffers", "Specifies the number of shared constant buffers.", false, defaults.NumSharedBuffers, "count");
+		TCLAP::ValueArg<uint32_t> localBuffersArg("", "local_buffers", "Specifies the number of non-shared constant buffers.", false, defaults.NumLocalBuffers, "count");
+		TCLAP::ValueArg<uint32_t> variablesArg("", "variables", "Specifies the number of variables per constant buffer.", false, defaults.VariablesPerBuffer, "count");
+		TCLAP::ValueArg<uint32_t> programSizeArg("", "program_size", "Specifies the size of the fake compiled programs, in bytes.", false, defaults.ProgramSize, "bytes");
+		TCLAP::ValueArg<uint32_t> seedArg("", "seed", "Specifies the seed of the fake compiled programs.", false, defaults.Seed, "seed");
+
+		cmd.add(outputArg);
+		cmd.add(generateArg);
+		cmd.add(filterArg);
+		cmd.add(minTimeArg);
+		cmd.add(techniquesArg);
+		cmd.add(passesArg);
+		cmd.add(programsArg);
+		cmd.add(samplersArg);
+		cmd.add(sharedBuffersArg);
+		cmd.add(localBuffersArg);
+		cmd.add(variablesArg);
+		cmd.add(programSizeArg);
+		cmd.add(seedArg);
+
+		cmd.parse(argc, argv);
+
+		sEffectGeneratorOptions options;
+		options.NumTechniques = techniquesArg.getValue();
+		options.PassesPerTechnique = passesArg.getValue();
+		options.NumPrograms = programsArg.getValue();
+		options.NumSamplers = samplersArg.getValue();
+		options.NumSharedBuffers = sharedBuffersArg.getValue();
+		options.NumLocalBuffers = localBuffersArg.getValue();
+		options.VariablesPerBuffer = variablesArg.getValue();
+		options.ProgramSize = programSizeArg.getValue();
+		options.Seed = seedArg.getValue();
+
+		CEffectGenerator generator(options);
+		const std::string source = generator.GenerateSource();
+
+		if (generateArg.isSet())
+		{
+			std::ofstream out(generateArg.getValue(), std::ios::binary);
+			out.write(source.data(), source.size());
+			if (!out)
+			{
+				throw std::runtime_error("Failed to write '" + generateArg.getValue().string() + "'");
+			}
+			return EXIT_SUCCESS;
+		}
+
+		CBenchmarkRunner runner(minTimeArg.getValue(), filterArg.getValue());
+		RunBenchmarks(runner, generator, source);
+
+		WriteTable(std::cout, runner.Results());
+
+		if (outputArg.isSet())
+		{
+			std::ofstream out(outputArg.getValue());
+			WriteJson(out, options, source.size(), runner.Results());
+			if (!out)
+			{
+				throw std::runtime_error("Failed to write '" + outputArg.getValue().string() + "'");
+			}
+		}
+
+		return EXIT_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+
+		return EXIT_FAILURE;
+	}
+}
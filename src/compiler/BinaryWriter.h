@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+
+// Writes values to a fixed size buffer. A writer without a buffer only counts the bytes written,
+// so the same code can be used to find the size of the buffer before writing to it.
+class CBinaryWriter
+{
+private:
+	uint8_t* mData;
+	size_t mCapacity;
+	size_t mPosition;
+
+public:
+	CBinaryWriter()
+		: mData(nullptr), mCapacity(0), mPosition(0)
+	{
+	}
+
+	CBinaryWriter(uint8_t* data, size_t capacity)
+		: mData(data), mCapacity(capacity), mPosition(0)
+	{
+	}
+
+	inline bool IsCounting() const { return mData == nullptr; }
+	inline size_t Position() const { return mPosition; }
+
+	inline void Write(const void* data, size_t size)
+	{
+		if (mData)
+		{
+			if (size > mCapacity - mPosition)
+			{
+				throw std::length_error("Write exceeds the buffer capacity");
+			}
+
+			memcpy(mData + mPosition, data, size);
+		}
+
+		mPosition += size;
+	}
+
+	inline void WriteUInt32(uint32_t v) { Write(&v, sizeof(uint32_t)); }
+	inline void WriteUInt16(uint16_t v) { Write(&v, sizeof(uint16_t)); }
+	inline void WriteUInt8(uint8_t v) { Write(&v, sizeof(uint8_t)); }
+};
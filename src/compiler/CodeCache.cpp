@@ -0,0 +1,289 @@
+#include "CodeCache.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include "Effect.h"
+#include "Hash.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr uint32_t EntryMagic = ('v' << 0) | ('f' << 8) | ('c' << 16) | ('c' << 24);
+	constexpr uint32_t EntryVersion = 2;
+
+	struct sEntryHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t Key;
+		tSha256Digest Digest; // the entry is shared between builds, a collision of Key would write the wrong program
+		uint32_t CodeSize;
+		uint32_t Padding;
+	};
+
+	template<typename T>
+	std::string_view AsBytes(const T& v)
+	{
+		return { reinterpret_cast<const char*>(&v), sizeof(T) };
+	}
+}
+
+CCodeCache::CCodeCache(const fs::path& directory, uint64_t maxSize, bool keepInMemory)
+	: mDirectory(directory.empty() ? fs::path() : fs::absolute(directory)), mMaxSize(maxSize),
+	mKeepInMemory(keepInMemory || directory.empty()), mMemorySize(0), mHits(0), mMisses(0), mInserts(0)
+{
+	if (mDirectory.empty())
+	{
+		return;
+	}
+
+	fs::create_directories(mDirectory);
+
+	if (!fs::is_directory(mDirectory))
+	{
+		throw std::invalid_argument("Cache path '" + mDirectory.string() + "' is not a directory");
+	}
+}
+
+CCodeCache::~CCodeCache() = default;
+
+std::unique_ptr<CCodeBlob> CCodeCache::Find(const sCodeCacheKey& key)
+{
+	std::unique_ptr<CCodeBlob> code = mKeepInMemory ? FindInMemory(key) : nullptr;
+	if (!code && !mDirectory.empty())
+	{
+		code = FindOnDisk(key);
+		if (code && mKeepInMemory)
+		{
+			InsertInMemory(key, *code);
+		}
+	}
+
+	if (code)
+	{
+		mHits++;
+	}
+	else
+	{
+		mMisses++;
+	}
+	return code;
+}
+
+std::unique_ptr<CCodeBlob> CCodeCache::FindOnDisk(const sCodeCacheKey& key)
+{
+	const fs::path entryPath = GetEntryPath(key.Hash);
+
+	std::error_code ec;
+	const uintmax_t fileSize = fs::file_size(entryPath, ec);
+	if (ec || fileSize < sizeof(sEntryHeader))
+	{
+		return nullptr;
+	}
+
+	std::ifstream file(entryPath, std::ios::binary | std::ios::in);
+	sEntryHeader header;
+	// the header comes from disk, check the size before allocating in case the file is corrupted
+	if (file && file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+		header.Magic == EntryMagic && header.Version == EntryVersion && header.Key == key.Hash &&
+		header.Digest == key.Digest && header.CodeSize == fileSize - sizeof(sEntryHeader))
+	{
+		std::vector<char> code(header.CodeSize);
+		if (file.read(code.data(), code.size()) && file.gcount() == static_cast<std::streamsize>(code.size()))
+		{
+			file.close();
+
+			// touch the entry so Trim removes the least recently used entries first
+			fs::last_write_time(entryPath, fs::file_time_type::clock::now(), ec);
+
+			return std::make_unique<CCodeBlob>(code.data(), header.CodeSize);
+		}
+	}
+
+	return nullptr;
+}
+
+std::unique_ptr<CCodeBlob> CCodeCache::FindInMemory(const sCodeCacheKey& key)
+{
+	std::lock_guard<std::mutex> lock(mMemoryMutex);
+	auto e = mMemoryEntries.find(key.Hash);
+	if (e == mMemoryEntries.end() || e->second.Digest != key.Digest)
+	{
+		return nullptr;
+	}
+
+	mMemoryLru.splice(mMemoryLru.begin(), mMemoryLru, e->second.LruPosition);
+	return std::make_unique<CCodeBlob>(e->second.Code->Data(), e->second.Code->Size());
+}
+
+void CCodeCache::InsertInMemory(const sCodeCacheKey& key, const CCodeBlob& code)
+{
+	std::lock_guard<std::mutex> lock(mMemoryMutex);
+	if (mMemoryEntries.count(key.Hash) != 0)
+	{
+		return;
+	}
+
+	mMemoryLru.push_front(key.Hash);
+	mMemoryEntries.try_emplace(key.Hash, sMemoryEntry{ std::make_unique<CCodeBlob>(code.Data(), code.Size()), key.Digest, mMemoryLru.begin() });
+	mMemorySize += code.Size();
+
+	// the most recently used entry is kept even if it is above the maximum size by itself
+	while (mMaxSize != 0 && mMemorySize > mMaxSize && mMemoryLru.size() > 1)
+	{
+		auto e = mMemoryEntries.find(mMemoryLru.back());
+		mMemorySize -= e->second.Code->Size();
+		mMemoryEntries.erase(e);
+		mMemoryLru.pop_back();
+	}
+}
+
+void CCodeCache::Insert(const sCodeCacheKey& key, const CCodeBlob& code)
+{
+	if (mKeepInMemory)
+	{
+		InsertInMemory(key, code);
+		if (mDirectory.empty())
+		{
+			mInserts++;
+			return;
+		}
+	}
+
+	// unique name for the temporary file so concurrent processes inserting the same entry don't
+	// write to the same file
+	static std::atomic<uint32_t> tmpCounter = 0;
+	static const uint64_t tmpSeed = (static_cast<uint64_t>(std::random_device()()) << 32) | std::random_device()();
+
+	const fs::path entryPath = GetEntryPath(key.Hash);
+	fs::path tmpPath = entryPath;
+	tmpPath += "." + std::to_string(tmpSeed) + "." + std::to_string(tmpCounter++) + ".tmp";
+
+	std::error_code ec;
+	fs::create_directories(entryPath.parent_path(), ec);
+
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::out | std::ios::trunc);
+		if (!file)
+		{
+			return; // failing to insert is not an error, the program will be compiled again next time
+		}
+
+		sEntryHeader header{ EntryMagic, EntryVersion, key.Hash, key.Digest, code.Size(), 0 };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(code.Data()), code.Size());
+		if (!file)
+		{
+			file.close();
+			fs::remove(tmpPath, ec);
+			return;
+		}
+	}
+
+	// readers only ever see complete entries, if another process already inserted the same entry
+	// it has the same contents so losing the rename is fine
+	fs::rename(tmpPath, entryPath, ec);
+	if (ec)
+	{
+		fs::remove(tmpPath, ec);
+		return;
+	}
+
+	mInserts++;
+}
+
+void CCodeCache::Trim()
+{
+	if (mMaxSize == 0 || mDirectory.empty())
+	{
+		return;
+	}
+
+	struct sEntry
+	{
+		fs::path Path;
+		uint64_t Size;
+		fs::file_time_type LastUse;
+	};
+
+	std::vector<sEntry> entries;
+	uint64_t totalSize = 0;
+
+	std::error_code ec;
+	for (auto it = fs::recursive_directory_iterator(mDirectory, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+	{
+		std::error_code entryEc;
+		if (!it->is_regular_file(entryEc) || it->path().extension() != ".bin")
+		{
+			continue;
+		}
+
+		sEntry e{ it->path(), it->file_size(entryEc), it->last_write_time(entryEc) };
+		if (!entryEc)
+		{
+			totalSize += e.Size;
+			entries.push_back(std::move(e));
+		}
+	}
+
+	if (totalSize <= mMaxSize)
+	{
+		return;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const sEntry& a, const sEntry& b) { return a.LastUse < b.LastUse; });
+
+	for (const auto& e : entries)
+	{
+		if (totalSize <= mMaxSize)
+		{
+			break;
+		}
+
+		// another process may have removed or replaced it already, ignore errors
+		if (fs::remove(e.Path, ec))
+		{
+			totalSize -= e.Size;
+		}
+	}
+}
+
+tSha256Digest CCodeCache::HashSource(std::string_view source)
+{
+	return sha256(source);
+}
+
+sCodeCacheKey CCodeCache::ComputeKey(const tSha256Digest& sourceHash, std::string_view entrypoint, std::string_view target, uint32_t flags, std::string_view compilerFingerprint)
+{
+	// hash the length of each field too so different fields can't be confused with each other
+	CSha256 sha;
+	sha.Update(AsBytes(EntryVersion));
+	sha.Update(AsBytes(sourceHash));
+	for (std::string_view field : { entrypoint, target, compilerFingerprint })
+	{
+		const uint64_t length = field.size();
+		sha.Update(AsBytes(length));
+		sha.Update(field);
+	}
+	sha.Update(AsBytes(flags));
+
+	sCodeCacheKey key;
+	key.Digest = sha.Finish();
+	key.Hash = sha256_prefix64(key.Digest);
+	return key;
+}
+
+fs::path CCodeCache::GetEntryPath(uint64_t key) const
+{
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key;
+
+	// split the entries in subdirectories to keep the directories small
+	const std::string nameStr = name.str();
+	return mDirectory / nameStr.substr(0, 2) / (nameStr + ".bin");
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include "Hash.h"
+
+class CCodeBlob;
+
+// Identifies the inputs of a compiled program, see CCodeCache::ComputeKey
+struct sCodeCacheKey
+{
+	uint64_t Hash = 0;			// names the entry, first bytes of Digest
+	tSha256Digest Digest{};		// of all the inputs, stored in the entry and compared on lookup
+};
+
+// Persistent cache of compiled programs, stored as one file per entry in a directory that can be
+// shared by multiple processes. Entries can also be kept in memory, for long running processes.
+class CCodeCache
+{
+private:
+	struct sMemoryEntry
+	{
+		std::unique_ptr<CCodeBlob> Code;
+		tSha256Digest Digest;
+		std::list<uint64_t>::iterator LruPosition;
+	};
+
+	std::filesystem::path mDirectory;
+	uint64_t mMaxSize;
+	bool mKeepInMemory;
+	std::mutex mMemoryMutex;
+	std::unordered_map<uint64_t, sMemoryEntry> mMemoryEntries;
+	std::list<uint64_t> mMemoryLru;		// keys of mMemoryEntries, most recently used first
+	uint64_t mMemorySize;
+	std::atomic<uint32_t> mHits;
+	std::atomic<uint32_t> mMisses;
+	std::atomic<uint32_t> mInserts;
+
+public:
+	// directory: if empty, the entries are only kept in memory
+	// maxSize: maximum size in bytes of all the entries on disk, and of the entries in memory, 0 for no limit
+	// keepInMemory: keeps the entries found or inserted in memory too, the least recently used are evicted
+	//               when they are above maxSize
+	CCodeCache(const std::filesystem::path& directory, uint64_t maxSize, bool keepInMemory = false);
+	~CCodeCache();
+	CCodeCache(const CCodeCache&) = delete;
+	CCodeCache& operator=(const CCodeCache&) = delete;
+
+	// Entries found with the same Hash but a different Digest are misses, the Hash collided
+	std::unique_ptr<CCodeBlob> Find(const sCodeCacheKey& key);
+	void Insert(const sCodeCacheKey& key, const CCodeBlob& code);
+	// Removes the least recently used entries on disk until the cache is below its maximum size
+	void Trim();
+
+	inline const std::filesystem::path& Directory() const { return mDirectory; }
+	inline uint32_t Hits() const { return mHits; }
+	inline uint32_t Misses() const { return mMisses; }
+	inline uint32_t Inserts() const { return mInserts; }
+
+	// Hashed separately, so the source is hashed once for all the programs compiled from it
+	static tSha256Digest HashSource(std::string_view source);
+	static sCodeCacheKey ComputeKey(const tSha256Digest& sourceHash, std::string_view entrypoint, std::string_view target, uint32_t flags, std::string_view compilerFingerprint);
+
+private:
+	std::filesystem::path GetEntryPath(uint64_t key) const;
+	std::unique_ptr<CCodeBlob> FindOnDisk(const sCodeCacheKey& key);
+	std::unique_ptr<CCodeBlob> FindInMemory(const sCodeCacheKey& key);
+	void InsertInMemory(const sCodeCacheKey& key, const CCodeBlob& code);
+};
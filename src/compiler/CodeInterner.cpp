@@ -0,0 +1,198 @@
+#include "CodeInterner.h"
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include "Effect.h"
+#include "Hash.h"
+
+// Number of entries before the entries of the programs no longer in use are first removed
+static constexpr size_t MinSweepSize = 1024;
+
+CCodeInterner::CCodeInterner(bool recordPrograms)
+	: mRecordPrograms(recordPrograms), mNextSweepSize(MinSweepSize), mStats{}
+{
+}
+
+std::shared_ptr<const void> CCodeInterner::InternSource(std::shared_ptr<const void> owner, std::string_view text, uint64_t hash)
+{
+	std::shared_ptr<const void> existing;
+	std::string_view existingText;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto e = mSources.find(hash);
+		if (e != mSources.end())
+		{
+			existing = e->second.Owner.lock();
+			existingText = e->second.Text;
+		}
+	}
+
+	// compared without the lock, the sources can be several megabytes
+	if (existing && (existing == owner || existingText == text))
+	{
+		return existing;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mSources[hash] = { owner, text };
+	SweepExpired();
+	return owner;
+}
+
+std::shared_ptr<CCodeBlob> CCodeInterner::FindCompiled(const sProgramInputs& inputs, std::string_view name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto e = mCompiled.find(inputs.Key);
+	if (e == mCompiled.end())
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<CCodeBlob> code = e->second.Code.lock();
+	if (!code)
+	{
+		mCompiled.erase(e);
+		return nullptr;
+	}
+
+	// the same key from different inputs, very unlikely
+	const sCompiled& c = e->second;
+	if (c.Source.lock() != inputs.Source || c.Entrypoint != inputs.Entrypoint || c.Target != inputs.Target || c.Flags != inputs.Flags)
+	{
+		return nullptr;
+	}
+
+	mStats.CompileHits++;
+	AddProgram(mEntries.at(e->second.Hash), name);
+	return code;
+}
+
+void CCodeInterner::AddProgram(sEntry& entry, std::string_view name)
+{
+	mStats.Programs++;
+	mStats.Bytes += entry.Size;
+	if (mRecordPrograms)
+	{
+		entry.Programs.emplace(name);
+	}
+}
+
+std::shared_ptr<CCodeBlob> CCodeInterner::Intern(std::unique_ptr<CCodeBlob> code, std::string_view name, const sProgramInputs* inputs)
+{
+	const uint32_t size = code->Size();
+	const uint64_t hash = fnv1a64(std::string_view(reinterpret_cast<const char*>(code->Data()), size));
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto [entry, inserted] = mEntries.try_emplace(hash);
+	sEntry& e = entry->second;
+	if (inserted)
+	{
+		e.Size = size;
+		mStats.UniquePrograms++;
+		mStats.UniqueBytes += size;
+	}
+	else if (e.Size != size)
+	{
+		// different bytecode with the same hash, very unlikely, it is just not shared
+		mStats.Programs++;
+		mStats.Bytes += size;
+		return std::shared_ptr<CCodeBlob>(std::move(code));
+	}
+
+	std::shared_ptr<CCodeBlob> interned = e.Code.lock();
+	if (interned && memcmp(interned->Data(), code->Data(), size) != 0)
+	{
+		mStats.Programs++;
+		mStats.Bytes += size;
+		return std::shared_ptr<CCodeBlob>(std::move(code));
+	}
+
+	if (!interned)
+	{
+		interned = std::move(code);
+		e.Code = interned;
+	}
+
+	AddProgram(e, name);
+
+	if (inputs)
+	{
+		mCompiled[inputs->Key] = { interned, hash, inputs->Source, std::string(inputs->Entrypoint), std::string(inputs->Target), inputs->Flags };
+	}
+
+	SweepExpired();
+	return interned;
+}
+
+void CCodeInterner::SweepExpired()
+{
+	if (mEntries.size() + mCompiled.size() + mSources.size() < mNextSweepSize)
+	{
+		return;
+	}
+
+	for (auto it = mCompiled.begin(); it != mCompiled.end();)
+	{
+		it = it->second.Code.expired() ? mCompiled.erase(it) : std::next(it);
+	}
+
+	for (auto it = mSources.begin(); it != mSources.end();)
+	{
+		it = it->second.Owner.expired() ? mSources.erase(it) : std::next(it);
+	}
+
+	// the names of the programs are needed for the report even once they are no longer in use
+	if (!mRecordPrograms)
+	{
+		for (auto it = mEntries.begin(); it != mEntries.end();)
+		{
+			it = it->second.Code.expired() ? mEntries.erase(it) : std::next(it);
+		}
+	}
+
+	// the cost of the sweeps stays proportional to the entries added
+	mNextSweepSize = std::max(MinSweepSize, 2 * (mEntries.size() + mCompiled.size() + mSources.size()));
+}
+
+sCodeInternerStats CCodeInterner::Stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+void CCodeInterner::WriteDuplicatesReport(std::ostream& out) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto wastedBytes = [](const sEntry& e) { return static_cast<uint64_t>(e.Size) * (e.Programs.size() - 1); };
+
+	std::vector<const sEntry*> duplicates;
+	for (const auto& [hash, e] : mEntries)
+	{
+		if (e.Programs.size() > 1)
+		{
+			duplicates.push_back(&e);
+		}
+	}
+
+	// ties sorted by name, so the report doesn't depend on the hash map order
+	std::sort(duplicates.begin(), duplicates.end(), [&wastedBytes](const sEntry* a, const sEntry* b)
+	{
+		const uint64_t wastedA = wastedBytes(*a), wastedB = wastedBytes(*b);
+		return wastedA != wastedB ? wastedA > wastedB : *a->Programs.begin() < *b->Programs.begin();
+	});
+
+	uint64_t totalWasted = 0;
+	for (const sEntry* e : duplicates)
+	{
+		totalWasted += wastedBytes(*e);
+		out << e->Programs.size() << " programs with the same " << e->Size << " bytes of bytecode, " << wastedBytes(*e) << " bytes duplicated:\n";
+		for (const std::string& p : e->Programs)
+		{
+			out << "  " << p << "\n";
+		}
+	}
+
+	out << duplicates.size() << " groups of programs with identical bytecode, " << totalWasted << " bytes duplicated\n";
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class CCodeBlob;
+
+struct sCodeInternerStats
+{
+	uint32_t Programs;			// programs interned or found with FindCompiled
+	uint64_t Bytes;				// bytecode of those programs, what they take without deduplication
+	uint32_t UniquePrograms;	// programs with bytecode different from the programs in use when they were interned
+	uint64_t UniqueBytes;		// bytecode of those programs
+	uint32_t CompileHits;		// programs not compiled because one with the same inputs was still in use
+};
+
+// Inputs a program is compiled from, the compiler is the same for the whole process
+struct sProgramInputs
+{
+	std::shared_ptr<const void> Source;	// returned by CCodeInterner::InternSource
+	std::string_view Entrypoint;
+	std::string_view Target;
+	uint32_t Flags = 0;
+	uint64_t Key = 0;					// sCodeCacheKey::Hash of the inputs
+};
+
+// Shares compiled programs with identical bytecode between the effects compiled in the process, so each
+// one is stored and reflected once while any effect uses it. The programs are not kept alive by the
+// interner and the entries of the programs no longer in use are removed, unless the names of the
+// programs are recorded for the report, so it doesn't grow in long running processes.
+class CCodeInterner
+{
+private:
+	struct sEntry
+	{
+		std::weak_ptr<CCodeBlob> Code;
+		uint32_t Size = 0;
+		std::set<std::string> Programs; // names of the programs with this bytecode, only if recorded
+	};
+
+	struct sCompiled
+	{
+		std::weak_ptr<CCodeBlob> Code;
+		uint64_t Hash = 0; // key of the entry in mEntries
+		// the inputs, compared on lookup so programs are only reused with identical inputs, not just the same key
+		std::weak_ptr<const void> Source;
+		std::string Entrypoint;
+		std::string Target;
+		uint32_t Flags = 0;
+	};
+
+	struct sSource
+	{
+		std::weak_ptr<const void> Owner;
+		std::string_view Text; // view of Owner
+	};
+
+	bool mRecordPrograms;
+	size_t mNextSweepSize; // number of entries in mEntries, mCompiled and mSources that triggers SweepExpired
+	mutable std::mutex mMutex;
+	std::unordered_map<uint64_t, sEntry> mEntries;							// by hash of the bytecode
+	std::unordered_map<uint64_t, sCompiled> mCompiled;						// by sCodeCacheKey::Hash of the inputs
+	std::unordered_map<uint64_t, sSource> mSources;							// by sha256_prefix64 of CCodeCache::HashSource
+	sCodeInternerStats mStats;
+
+public:
+	// recordPrograms: keeps the names of the programs with each bytecode, for WriteDuplicatesReport
+	CCodeInterner(bool recordPrograms = false);
+	CCodeInterner(const CCodeInterner&) = delete;
+	CCodeInterner& operator=(const CCodeInterner&) = delete;
+
+	// Returns the owner of a source identical to `text` still in use, or `owner` if there is none. The
+	// programs are only found by FindCompiled for the same owner, so the text of the sources is compared
+	// once per effect instead of once per program.
+	// owner: keeps `text` alive
+	// hash: sha256_prefix64 of CCodeCache::HashSource of `text`
+	std::shared_ptr<const void> InternSource(std::shared_ptr<const void> owner, std::string_view text, uint64_t hash);
+	// Returns the program compiled from the same inputs, if it is still in use
+	// name: identifies the program in the report, e.g. 'effect.fx:VS_Main'
+	std::shared_ptr<CCodeBlob> FindCompiled(const sProgramInputs& inputs, std::string_view name);
+	// Returns the program in use with the same bytecode as `code`, or `code` itself if there is none.
+	// name: identifies the program in the report, e.g. 'effect.fx:VS_Main'
+	// inputs: if not null, the program can be found with FindCompiled
+	std::shared_ptr<CCodeBlob> Intern(std::unique_ptr<CCodeBlob> code, std::string_view name, const sProgramInputs* inputs = nullptr);
+
+	sCodeInternerStats Stats() const;
+	// Writes the groups of programs with identical bytecode, largest waste first. Requires recordPrograms.
+	void WriteDuplicatesReport(std::ostream& out) const;
+
+private:
+	void AddProgram(sEntry& entry, std::string_view name);
+	// Removes the entries of the programs no longer in use once there are enough of them
+	void SweepExpired();
+};
@@ -0,0 +1,492 @@
+#ifdef _WIN32
+// must be included before windows.h, which is included by the D3D headers
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "CompileServer.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "CodeCache.h"
+#include "Effect.h"
+#include "EffectSaver.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+#ifdef _WIN32
+	using tSocket = SOCKET;
+	constexpr tSocket InvalidSocket = INVALID_SOCKET;
+	void CloseSocket(tSocket s) { closesocket(s); }
+
+	// std::filesystem doesn't report AF_UNIX sockets on Windows, they are reparse points with their own tag
+	bool IsSocketFile(const fs::path& path)
+	{
+		WIN32_FIND_DATAW data;
+		const HANDLE find = FindFirstFileW(path.c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		FindClose(find);
+		return (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) && data.dwReserved0 == IO_REPARSE_TAG_AF_UNIX;
+	}
+#else
+	using tSocket = int;
+	constexpr tSocket InvalidSocket = -1;
+	void CloseSocket(tSocket s) { close(s); }
+
+	bool IsSocketFile(const fs::path& path)
+	{
+		std::error_code ec;
+		return fs::is_socket(fs::symlink_status(path, ec));
+	}
+#endif
+
+	// Buffered stream over a connected socket
+	class CSocketStreamBuf : public std::streambuf
+	{
+	private:
+		tSocket mSocket;
+		char mInput[16 * 1024];
+		char mOutput[16 * 1024];
+
+	public:
+		CSocketStreamBuf(tSocket s)
+			: mSocket(s)
+		{
+			setg(mInput, mInput, mInput);
+			setp(mOutput, mOutput + sizeof(mOutput));
+		}
+
+		~CSocketStreamBuf()
+		{
+			sync();
+			CloseSocket(mSocket);
+		}
+
+	protected:
+		int_type underflow() override
+		{
+			const int received = recv(mSocket, mInput, static_cast<int>(sizeof(mInput)), 0);
+			if (received <= 0)
+			{
+				return traits_type::eof();
+			}
+
+			setg(mInput, mInput, mInput + received);
+			return traits_type::to_int_type(mInput[0]);
+		}
+
+		int_type overflow(int_type c) override
+		{
+			if (sync() != 0)
+			{
+				return traits_type::eof();
+			}
+
+			if (!traits_type::eq_int_type(c, traits_type::eof()))
+			{
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+
+		int sync() override
+		{
+			const char* p = pbase();
+			while (p < pptr())
+			{
+				const int sent = send(mSocket, p, static_cast<int>(pptr() - p), 0);
+				if (sent <= 0)
+				{
+					return -1;
+				}
+				p += sent;
+			}
+
+			setp(mOutput, mOutput + sizeof(mOutput));
+			return 0;
+		}
+	};
+
+	eCompileMode ParseMode(const std::string& mode)
+	{
+		if (mode == "compile") return eCompileMode::Compile;
+		if (mode == "preprocess") return eCompileMode::Preprocess;
+		if (mode == "validate") return eCompileMode::Validate;
+		throw std::invalid_argument("Unknown mode '" + mode + "'");
+	}
+
+	size_t ParseSize(const std::string& size)
+	{
+		size_t end = 0;
+		const unsigned long long value = std::stoull(size, &end);
+		if (end != size.size())
+		{
+			throw std::invalid_argument("Invalid size '" + size + "'");
+		}
+		return static_cast<size_t>(value);
+	}
+
+	std::string ReadFile(const fs::path& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::in);
+		if (!file)
+		{
+			throw std::runtime_error("Failed to read file '" + path.string() + "'");
+		}
+
+		std::stringstream contents;
+		contents << file.rdbuf();
+		return contents.str();
+	}
+}
+
+CCompileServer::CCompileServer(uint32_t numJobs, CCodeCache* cache)
+	: mNumJobs(numJobs > 0 ? numJobs : 1), mCache(cache),
+	mIncludeCache(false, true), // the include files may change between requests
+	mRequestsSinceTrim(0), mStopping(false)
+{
+	for (uint32_t i = 0; i < mNumJobs; i++)
+	{
+		mWorkers.emplace_back(&CCompileServer::RunWorker, this);
+	}
+}
+
+CCompileServer::~CCompileServer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mQueueMutex);
+		mStopping = true;
+	}
+	mQueueCondition.notify_all();
+
+	for (auto& w : mWorkers)
+	{
+		w.join();
+	}
+}
+
+void CCompileServer::Serve(std::istream& in, std::ostream& out)
+{
+	std::mutex outMutex;
+	std::mutex pendingMutex;
+	std::condition_variable pendingCondition;
+	size_t pending = 0;
+
+	auto respond = [&out, &outMutex](const sServerResponse& response)
+	{
+		std::lock_guard<std::mutex> lock(outMutex);
+		WriteResponse(out, response);
+		out.flush();
+	};
+
+	while (true)
+	{
+		sServerRequest request;
+		try
+		{
+			if (!ReadRequest(in, request))
+			{
+				break;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			// the rest of the stream can't be trusted anymore
+			sServerResponse response;
+			response.Id = request.Id;
+			response.Data = std::string("Invalid request: ") + e.what();
+			respond(response);
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			pending++;
+		}
+
+		Enqueue([this, request = std::move(request), &respond, &pendingMutex, &pendingCondition, &pending]()
+		{
+			respond(Process(request));
+			if (++mRequestsSinceTrim >= TrimInterval)
+			{
+				TrimCache();
+			}
+
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			if (--pending == 0)
+			{
+				pendingCondition.notify_all();
+			}
+		});
+	}
+
+	std::unique_lock<std::mutex> lock(pendingMutex);
+	pendingCondition.wait(lock, [&pending]() { return pending == 0; });
+}
+
+void CCompileServer::Listen(const fs::path& socketPath)
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		throw std::runtime_error("Failed to initialize Winsock");
+	}
+#endif
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	const std::string pathStr = socketPath.string();
+	if (pathStr.size() >= sizeof(address.sun_path))
+	{
+		throw std::invalid_argument("Socket path '" + pathStr + "' is too long");
+	}
+	pathStr.copy(address.sun_path, pathStr.size());
+
+	const tSocket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == InvalidSocket)
+	{
+		throw std::runtime_error("Failed to create socket");
+	}
+
+	// remove the socket left by a previous server, but never a file that isn't a socket
+	std::error_code ec;
+	if (IsSocketFile(socketPath))
+	{
+		fs::remove(socketPath, ec);
+	}
+	else if (fs::exists(fs::symlink_status(socketPath, ec)))
+	{
+		CloseSocket(listener);
+		throw std::invalid_argument("Socket path '" + pathStr + "' exists and is not a socket");
+	}
+
+	if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+		listen(listener, SOMAXCONN) != 0)
+	{
+		CloseSocket(listener);
+		throw std::runtime_error("Failed to listen on '" + pathStr + "'");
+	}
+
+	while (true)
+	{
+		const tSocket connection = accept(listener, nullptr, nullptr);
+		if (connection == InvalidSocket)
+		{
+			continue;
+		}
+
+		std::thread([this, connection]()
+		{
+			// separate streams over the same buffer, the requests are read on this thread while the workers
+			// write the responses, and the end of the requests must not fail the responses still pending
+			CSocketStreamBuf buffer(connection);
+			std::istream in(&buffer);
+			std::ostream out(&buffer);
+			Serve(in, out);
+
+			TrimCache();
+		}).detach();
+	}
+}
+
+sServerResponse CCompileServer::Process(const sServerRequest& request)
+{
+	sServerResponse response;
+	response.Id = request.Id;
+
+	try
+	{
+		sEffectOptions options;
+		options.NumJobs = 1; // parallelism comes from processing multiple requests
+		options.Cache = mCache;
+		options.IncludeCache = &mIncludeCache;
+		options.Interner = &mCodeInterner;
+		options.Defines = request.Defines;
+		options.Techniques = request.Techniques;
+
+		const fs::path inputPath = fs::absolute(request.InputPath);
+		CEffect fx(request.Source ? *request.Source : ReadFile(inputPath), inputPath, request.IncludeDirectories, options);
+
+		switch (request.Mode)
+		{
+		case eCompileMode::Compile:
+		{
+			fx.EnsureProgramsReflection();
+
+			const std::vector<uint8_t> fxc = CEffectSaver(fx).SaveToMemory();
+			response.Data.assign(reinterpret_cast<const char*>(fxc.data()), fxc.size());
+			break;
+		}
+
+		case eCompileMode::Preprocess:
+			fx.EnsurePreprocessedSource();
+			response.Data.assign(fx.PreprocessedSource());
+			break;
+
+		case eCompileMode::Validate:
+			fx.EnsureTechniques();
+			break;
+		}
+
+		// validating produces no output, like in the command line, don't truncate the output file
+		if (!request.OutputPath.empty() && request.Mode != eCompileMode::Validate)
+		{
+			std::ofstream outputFile(request.OutputPath, std::ios::binary | std::ios::out | std::ios::trunc);
+			outputFile.write(response.Data.data(), response.Data.size());
+			if (!outputFile)
+			{
+				throw std::runtime_error("Failed to write file '" + request.OutputPath.string() + "'");
+			}
+			response.Data.clear();
+		}
+
+		response.Succeeded = true;
+	}
+	catch (const std::exception& e)
+	{
+		response.Succeeded = false;
+		response.Data = e.what();
+	}
+
+	return response;
+}
+
+bool CCompileServer::ReadRequest(std::istream& in, sServerRequest& outRequest)
+{
+	std::string line;
+
+	// skip empty lines between requests
+	do
+	{
+		if (!std::getline(in, line))
+		{
+			return false;
+		}
+
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+	} while (line.empty());
+
+	size_t sourceSize = 0;
+	bool hasSource = false;
+	do
+	{
+		const size_t separator = line.find(' ');
+		const std::string key = line.substr(0, separator);
+		const std::string value = separator == std::string::npos ? std::string() : line.substr(separator + 1);
+
+		if (key == "id") outRequest.Id = value;
+		else if (key == "mode") outRequest.Mode = ParseMode(value);
+		else if (key == "input") outRequest.InputPath = value;
+		else if (key == "include") outRequest.IncludeDirectories.push_back(value);
+		else if (key == "define") outRequest.Defines.push_back(CEffectCompiler::ParseDefine(value));
+		else if (key == "technique") outRequest.Techniques.push_back(value);
+		else if (key == "output") outRequest.OutputPath = value;
+		else if (key == "source")
+		{
+			sourceSize = ParseSize(value);
+			if (sourceSize > MaxSourceSize)
+			{
+				throw std::invalid_argument("Source size " + value + " is above the maximum of " + std::to_string(MaxSourceSize) + " bytes");
+			}
+			hasSource = true;
+		}
+		else
+		{
+			throw std::invalid_argument("Unknown key '" + key + "'");
+		}
+
+		if (!std::getline(in, line))
+		{
+			throw std::runtime_error("Unexpected end of stream");
+		}
+
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+	} while (!line.empty());
+
+	if (hasSource)
+	{
+		std::string source(sourceSize, '\0');
+		if (!in.read(source.data(), sourceSize))
+		{
+			throw std::runtime_error("Unexpected end of stream");
+		}
+		outRequest.Source = std::move(source);
+	}
+
+	if (outRequest.InputPath.empty())
+	{
+		throw std::invalid_argument("Missing input path");
+	}
+
+	return true;
+}
+
+void CCompileServer::WriteResponse(std::ostream& out, const sServerResponse& response)
+{
+	if (!response.Id.empty())
+	{
+		out << "id " << response.Id << "\n";
+	}
+	out << "status " << (response.Succeeded ? "ok" : "error") << "\n";
+	out << "size " << response.Data.size() << "\n\n";
+	out.write(response.Data.data(), response.Data.size());
+}
+
+void CCompileServer::TrimCache()
+{
+	// the server may run until it is killed, so the cache is trimmed as it goes like in watch mode. If
+	// another thread is already trimming it, that one is enough.
+	std::unique_lock<std::mutex> lock(mTrimMutex, std::try_to_lock);
+	if (mCache && lock.owns_lock())
+	{
+		mRequestsSinceTrim = 0;
+		mCache->Trim();
+	}
+}
+
+void CCompileServer::Enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mQueueMutex);
+		mQueue.push_back(std::move(task));
+	}
+	mQueueCondition.notify_one();
+}
+
+void CCompileServer::RunWorker()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mQueueMutex);
+			mQueueCondition.wait(lock, [this]() { return mStopping || !mQueue.empty(); });
+			if (mQueue.empty())
+			{
+				return;
+			}
+
+			task = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CodeInterner.h"
+#include "EffectCompiler.h"
+#include "IncludeCache.h"
+
+class CCodeCache;
+
+struct sServerRequest
+{
+	std::string Id;									// returned as is in the response
+	eCompileMode Mode = eCompileMode::Compile;
+	std::filesystem::path InputPath;				// used to find local includes and in error messages
+	std::optional<std::string> Source;				// if not set, the source is read from InputPath
+	std::vector<std::filesystem::path> IncludeDirectories;
+	std::vector<sEffectDefine> Defines;
+	std::vector<std::string> Techniques;			// see sEffectOptions::Techniques
+	std::filesystem::path OutputPath;				// if set, the output is saved to this file instead of returned
+};
+
+struct sServerResponse
+{
+	std::string Id;
+	bool Succeeded = false;
+	std::string Data;								// the output or the error message
+};
+
+// Compiles effects on request, keeping the include files and compiled programs cached between
+// requests. Requests and responses are sent as a header of `key value` lines ended by an empty
+// line, followed by the payload:
+//
+//   request:  id <string>, mode <compile|preprocess|validate>, input <path>, source <size>,
+//             include <directory>, define <NAME[=VALUE]>, technique <pattern>, output <path>
+//             `include`, `define` and `technique` can be repeated, only `input` is required. The payload is the
+//             source, with the size given in `source`, at most MaxSourceSize bytes.
+//   response: id <string>, status <ok|error>, size <size>
+//             The payload is the .fxc file, the preprocessed source or the error message. It is
+//             empty if the output was saved to a file.
+//
+// Requests are processed concurrently, so the responses may be sent in a different order.
+class CCompileServer
+{
+public:
+	static constexpr uint32_t TrimInterval = 256;
+	// the size of the source comes from the client, larger requests are rejected instead of allocated
+	static constexpr size_t MaxSourceSize = 64 * 1024 * 1024;
+
+private:
+	uint32_t mNumJobs;
+	CCodeCache* mCache;
+	CIncludeCache mIncludeCache;
+	CCodeInterner mCodeInterner; // shares the programs of the requests processed at the same time
+	std::mutex mTrimMutex;
+	std::atomic<uint32_t> mRequestsSinceTrim;
+
+	std::mutex mQueueMutex;
+	std::condition_variable mQueueCondition;
+	std::deque<std::function<void()>> mQueue;
+	bool mStopping;
+	std::vector<std::thread> mWorkers;
+
+public:
+	// numJobs: number of requests processed at the same time
+	CCompileServer(uint32_t numJobs, CCodeCache* cache);
+	~CCompileServer();
+	CCompileServer(const CCompileServer&) = delete;
+	CCompileServer& operator=(const CCompileServer&) = delete;
+
+	// Processes the requests read from `in` until the end of the stream, returns once all the responses are written.
+	// The cache is trimmed every TrimInterval requests.
+	void Serve(std::istream& in, std::ostream& out);
+	// Listens on a Unix domain socket, each connection is served as a stream. The cache is also trimmed after
+	// each connection. Never returns.
+	[[noreturn]] void Listen(const std::filesystem::path& socketPath);
+
+	sServerResponse Process(const sServerRequest& request);
+
+	// Returns false at the end of the stream. Throws if the request can't be read, in which case
+	// the stream can't be read any further.
+	static bool ReadRequest(std::istream& in, sServerRequest& outRequest);
+	static void WriteResponse(std::ostream& out, const sServerResponse& response);
+
+private:
+	void TrimCache();
+	void Enqueue(std::function<void()> task);
+	void RunWorker();
+};
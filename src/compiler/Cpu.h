@@ -0,0 +1,16 @@
+#pragma once
+
+// x86-64 builds can use SSE2 unconditionally, and AVX2 once IsAVX2Supported returns true
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_X86 1
+#endif
+
+// GCC and Clang only allow AVX2 intrinsics in functions compiled for it, MSVC allows them anywhere
+#if CPU_X86 && defined(__GNUC__)
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_TARGET_AVX2
+#endif
+
+// Returns whether both the CPU and the OS support AVX2
+bool IsAVX2Supported();
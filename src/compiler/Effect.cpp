@@ -1,18 +1,27 @@
 #include "Effect.h"
+#ifdef _WIN32
 #include <d3dcompiler.h>
-#include <d3d11.h>
 #include <atlbase.h>
 #include "EffectInclude.h"
+#endif
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+#include "D3D11Enums.h"
 #include "EffectParser.h"
+#include "Parallel.h"
+#include "CodeCache.h"
+#include "CodeInterner.h"
+#include "Trace.h"
+#include "Wildcard.h"
 
 namespace fs = std::filesystem;
 
-CEffect::CEffect(const std::string& source, const fs::path& sourceFilename, const std::vector<fs::path>& includeDirs)
-	: mSource(source), mSourceFilename(fs::absolute(sourceFilename)),
-	mInclude(std::make_unique<CEffectInclude>(mSourceFilename.parent_path(), includeDirs))
+CEffect::CEffect(const std::string& source, const fs::path& sourceFilename, const std::vector<fs::path>& includeDirs, const sEffectOptions& options)
+	: mSource(source), mSourcePreprocessed(false), mSourceFilename(fs::absolute(sourceFilename)), mTechniquesParsed(false), mIncludeDirectories(includeDirs),
+	mOptions(options)
 {
-	EnsureTechniques();
-	EnsureProgramsCode();
 }
 
 const CCodeBlob& CEffect::GetProgramCode(const std::string& entrypoint) const
@@ -28,74 +37,305 @@ const CCodeBlob& CEffect::GetProgramCode(const std::string& entrypoint) const
 	}
 }
 
-std::string CEffect::PreprocessSource() const
+std::string_view CEffect::PreprocessSource(std::shared_ptr<const void>& outOwner, std::set<fs::path>* outIncludedFiles) const
 {
+#ifdef _WIN32
+	CEffectInclude include(mSourceFilename.parent_path(), mIncludeDirectories, mOptions.IncludeCache);
+
+	std::vector<D3D_SHADER_MACRO> macros;
+	macros.reserve(mOptions.Defines.size() + 1);
+	for (const auto& d : mOptions.Defines)
+	{
+		macros.push_back({ d.Name.c_str(), d.Value.c_str() });
+	}
+	macros.push_back({ nullptr, nullptr });
+
+	CTraceScope trace("preprocess", mSourceFilename.filename().string());
+
 	CComPtr<ID3DBlob> codeText, errorMsg;
 	std::string sourceFileStr = mSourceFilename.string();
-	HRESULT r = D3DPreprocess(mSource.c_str(), mSource.size(), sourceFileStr.c_str(), nullptr, mInclude.get(), &codeText, &errorMsg);
+	HRESULT r = D3DPreprocess(mSource.c_str(), mSource.size(), sourceFileStr.c_str(), macros.data(), &include, &codeText, &errorMsg);
+	if (outIncludedFiles)
+	{
+		*outIncludedFiles = include.IncludedFiles();
+	}
+
 	if (SUCCEEDED(r))
 	{
-		return std::string(reinterpret_cast<const char*>(codeText->GetBufferPointer()), static_cast<size_t>(codeText->GetBufferSize()) - 1); // -1 to exclude null terminator from string length
+		std::string_view text(reinterpret_cast<const char*>(codeText->GetBufferPointer()), static_cast<size_t>(codeText->GetBufferSize()) - 1); // -1 to exclude null terminator from string length
+		outOwner = std::shared_ptr<ID3DBlob>(codeText.Detach(), [](ID3DBlob* b) { b->Release(); });
+		return text;
 	}
 	else
 	{
 		throw std::runtime_error(errorMsg ? reinterpret_cast<const char*>(errorMsg->GetBufferPointer()) : "Preprocessor error");
 	}
+#else
+	throw std::runtime_error("Preprocessing requires the D3D compiler, which is not available on this platform");
+#endif
 }
 
-void CEffect::EnsureTechniques()
+void CEffect::EnsurePreprocessedSource()
 {
-	if (!mTechniques.empty())
+	if (mSourcePreprocessed)
 	{
 		return;
 	}
 
-	std::string src = PreprocessSource();
-	CEffectParser parser(src);
-	mTechniques = parser.GetTechniques();
+	// the preprocessed source is used both for parsing and as the input of every CompileProgram call,
+	// so the include files are only opened once per effect
+	mPreprocessedSource = PreprocessSource(mPreprocessedSourceOwner, &mIncludedFiles);
+	mSourcePreprocessed = true;
+}
 
-	// TODO: move mSharedVariables and mSamplerState initialization somewhere else
-	mSharedVariables = parser.GetSharedVariablesNames();
-	mSamplerStates = parser.GetSamplerStates();
+void CEffect::SetPreprocessedSource(std::string preprocessedSource)
+{
+	auto owner = std::make_shared<const std::string>(std::move(preprocessedSource));
+	mPreprocessedSource = *owner;
+	mPreprocessedSourceOwner = std::move(owner);
+	mSourcePreprocessed = true;
 }
 
-void CEffect::EnsureProgramsCode()
+void CEffect::SetProgramCode(const std::string& entrypoint, std::unique_ptr<CCodeBlob> code)
+{
+	mProgramsCode[entrypoint] = std::move(code);
+}
+
+void CEffect::EnsureTechniques()
 {
-	if (!mProgramsCode.empty())
+	if (mTechniquesParsed)
 	{
 		return;
 	}
 
+	EnsurePreprocessedSource();
+
+	sParsedEffect parsed;
+	{
+		CTraceScope trace("parse", "effect_grammar", mSourceFilename.filename().string());
+		parsed = CEffectParser(mPreprocessedSource).Parse(mOptions.NumJobs);
+	}
+
+	mTechniques = std::move(parsed.Techniques);
+	std::move(std::begin(parsed.Programs), std::end(parsed.Programs), std::begin(mPrograms));
+	if (!mOptions.Techniques.empty() && !mTechniques.empty())
+	{
+		FilterTechniques();
+		if (mTechniques.empty())
+		{
+			// an effect without techniques is fine, e.g. a file only meant to be included by other effects
+			throw std::runtime_error("No technique in '" + mSourceFilename.string() + "' matches the technique filter");
+		}
+	}
+	mSharedVariables = std::move(parsed.SharedVariables);
+	mSamplerStates = std::move(parsed.SamplerStates);
+
+	mSharedVariablesLookup.clear();
+	mSharedVariablesLookup.insert(mSharedVariables.begin(), mSharedVariables.end());
+
+	// if multiple samplers have the same name, the first one is used
+	mSamplerStatesLookup.clear();
+	for (size_t i = 0; i < mSamplerStates.size(); i++)
+	{
+		mSamplerStatesLookup.try_emplace(mSamplerStates[i].Name, i);
+	}
+
+	mTechniquesParsed = true;
+}
+
+void CEffect::FilterTechniques()
+{
+	const std::vector<std::string>& patterns = mOptions.Techniques;
+	mTechniques.erase(std::remove_if(mTechniques.begin(), mTechniques.end(), [&patterns](const sTechnique& t)
+	{
+		return std::none_of(patterns.begin(), patterns.end(), [&t](const std::string& p) { return MatchesWildcard(p, t.Name); });
+	}), mTechniques.end());
+
+	for (size_t type = 0; type < static_cast<size_t>(eProgramType::NumberOfTypes); type++)
+	{
+		// newIds[id] is the index + 1 of the program in the remaining programs, which stay sorted
+		std::vector<uint16_t> newIds(mPrograms[type].size() + 1, 0);
+		for (const sTechnique& t : mTechniques)
+		{
+			for (const sTechniquePass& p : t.Passes)
+			{
+				newIds[p.Programs[type]] = 1;
+			}
+		}
+
+		std::vector<std::string_view> programs;
+		for (size_t id = 1; id < newIds.size(); id++)
+		{
+			if (newIds[id] != 0)
+			{
+				programs.push_back(mPrograms[type][id - 1]);
+				newIds[id] = static_cast<uint16_t>(programs.size());
+			}
+		}
+		newIds[0] = 0; // NULL program
+		mPrograms[type] = std::move(programs);
+
+		for (sTechnique& t : mTechniques)
+		{
+			for (sTechniquePass& p : t.Passes)
+			{
+				p.Programs[type] = newIds[p.Programs[type]];
+			}
+		}
+	}
+}
+
+void CEffect::EnsureProgramsCode()
+{
+	EnsureTechniques();
+
+	// list the programs in the same order they were compiled serially, so the resulting map doesn't
+	// depend on the number of jobs. The programs set with SetProgramCode or compiled by a previous call
+	// are not compiled again.
+	std::vector<std::pair<std::string, eProgramType>> programs;
 	for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
 	{
 		eProgramType type = static_cast<eProgramType>(i);
 
-		std::set<std::string> entrypoints;
-		GetUsedPrograms(entrypoints, type);
-
-		for (const auto& e : entrypoints)
+		for (std::string_view e : Programs(type))
 		{
-			mProgramsCode.insert({ e, CompileProgram(e, type) });
+			if (mProgramsCode.find(std::string(e)) == mProgramsCode.end())
+			{
+				programs.emplace_back(e, type);
+			}
 		}
 	}
+
+	if (programs.empty())
+	{
+		return;
+	}
+
+	// the source can be several megabytes, hash it once instead of for each program
+	const tSha256Digest sourceHash = mOptions.Cache || mOptions.Interner ? CCodeCache::HashSource(mPreprocessedSource) : tSha256Digest{};
+	if (mOptions.Interner)
+	{
+		mInternedSource = mOptions.Interner->InternSource(mPreprocessedSourceOwner, mPreprocessedSource, sha256_prefix64(sourceHash));
+	}
+
+	std::vector<std::shared_ptr<CCodeBlob>> code(programs.size());
+	ParallelFor(programs.size(), mOptions.NumJobs, [this, &programs, &code, &sourceHash](size_t i)
+	{
+		code[i] = CompileProgram(programs[i].first, programs[i].second, sourceHash);
+	});
+
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		mProgramsCode.insert({ programs[i].first, std::move(code[i]) });
+	}
+}
+
+void CEffect::EnsureProgramsReflection()
+{
+	EnsureProgramsCode();
+
+	std::vector<std::pair<const std::string*, CCodeBlob*>> programs;
+	programs.reserve(mProgramsCode.size());
+	for (auto& p : mProgramsCode)
+	{
+		programs.emplace_back(&p.first, p.second.get());
+	}
+
+	ParallelFor(programs.size(), mOptions.NumJobs, [this, &programs](size_t i)
+	{
+		CTraceScope trace("reflect", *programs[i].first, mSourceFilename.filename().string());
+		programs[i].second->EnsureReflection();
+	});
 }
 
-std::unique_ptr<CCodeBlob> CEffect::CompileProgram(const std::string& entrypoint, eProgramType type) const
+#ifdef _WIN32
+// Identifies the d3dcompiler DLL loaded in this process, so cached programs are not reused once the compiler changes
+static const std::string& GetCompilerFingerprint()
 {
+	static const std::string fingerprint = []()
+	{
+		std::string f = D3DCOMPILER_DLL_A;
+
+		wchar_t modulePath[MAX_PATH];
+		HMODULE module = GetModuleHandleA(D3DCOMPILER_DLL_A);
+		if (module && GetModuleFileNameW(module, modulePath, MAX_PATH) > 0)
+		{
+			std::error_code ec;
+			fs::path p = modulePath;
+			f += ";" + std::to_string(fs::file_size(p, ec));
+			f += ";" + std::to_string(fs::last_write_time(p, ec).time_since_epoch().count());
+		}
+
+		return f;
+	}();
+
+	return fingerprint;
+}
+#endif
+
+std::shared_ptr<CCodeBlob> CEffect::CompileProgram(const std::string& entrypoint, eProgramType type, const tSha256Digest& sourceHash) const
+{
+#ifdef _WIN32
 	// Flags used in the game shaders (except for D3DCOMPILE_NO_PRESHADER, which doesn't seem to be supported in our version of d3dcompile)
 	constexpr uint32_t Flags = D3DCOMPILE_PACK_MATRIX_ROW_MAJOR | D3DCOMPILE_ENABLE_BACKWARDS_COMPATIBILITY;
 
+	CTraceScope trace("compile", entrypoint, mSourceFilename.filename().string());
+
+	sProgramInputs inputs;
+	inputs.Source = mInternedSource;
+	inputs.Entrypoint = entrypoint;
+	inputs.Target = GetTargetForProgram(type);
+	inputs.Flags = Flags;
+	const sCodeCacheKey cacheKey = mOptions.Cache || mOptions.Interner ? CCodeCache::ComputeKey(sourceHash, inputs.Entrypoint, inputs.Target, Flags, GetCompilerFingerprint()) : sCodeCacheKey();
+	inputs.Key = cacheKey.Hash;
+
+	// the program is only compiled again if the inputs changed, and identical bytecode is shared with the other effects
+	auto intern = [this, &entrypoint, &inputs](std::unique_ptr<CCodeBlob> blob) -> std::shared_ptr<CCodeBlob>
+	{
+		if (!mOptions.Interner)
+		{
+			return blob;
+		}
+		return mOptions.Interner->Intern(std::move(blob), mSourceFilename.string() + ":" + entrypoint, &inputs);
+	};
+
+	if (mOptions.Interner)
+	{
+		if (std::shared_ptr<CCodeBlob> compiled = mOptions.Interner->FindCompiled(inputs, mSourceFilename.string() + ":" + entrypoint))
+		{
+			return compiled;
+		}
+	}
+
+	if (mOptions.Cache)
+	{
+		if (std::unique_ptr<CCodeBlob> cached = mOptions.Cache->Find(cacheKey))
+		{
+			return intern(std::move(cached));
+		}
+	}
+
+	// compile from the preprocessed source, it no longer has any #include and its #line directives
+	// still map errors to the original files
 	CComPtr<ID3DBlob> code, errorMsg;
 	std::string sourceFileStr = mSourceFilename.string();
-	HRESULT r = D3DCompile(mSource.c_str(), mSource.size(), sourceFileStr.c_str(), nullptr, mInclude.get(), entrypoint.c_str(), GetTargetForProgram(type), Flags, 0, &code, &errorMsg);
+	HRESULT r = D3DCompile(mPreprocessedSource.data(), mPreprocessedSource.size(), sourceFileStr.c_str(), nullptr, nullptr, entrypoint.c_str(), GetTargetForProgram(type), Flags, 0, &code, &errorMsg);
 	if (SUCCEEDED(r))
 	{
-		return std::make_unique<CCodeBlob>(code->GetBufferPointer(), static_cast<uint32_t>(code->GetBufferSize()));
+		auto blob = std::make_unique<CCodeBlob>(code->GetBufferPointer(), static_cast<uint32_t>(code->GetBufferSize()));
+		if (mOptions.Cache)
+		{
+			mOptions.Cache->Insert(cacheKey, *blob);
+		}
+		return intern(std::move(blob));
 	}
 	else
 	{
 		throw std::runtime_error(errorMsg ? reinterpret_cast<const char*>(errorMsg->GetBufferPointer()) : "Compilation error");
 	}
+#else
+	throw std::runtime_error("Compiling '" + entrypoint + "' requires the D3D compiler, which is not available on this platform");
+#endif
 }
 
 const char* CEffect::GetTargetForProgram(eProgramType type)
@@ -128,60 +368,51 @@ const char* CEffect::GetAssignmentTypeForProgram(eProgramType type)
 	throw std::invalid_argument("Invalid program type");
 }
 
-void CEffect::GetUsedPrograms(std::set<std::string>& outEntrypoints, eProgramType type) const
+bool CEffect::IsSharedVariable(std::string_view name) const
+{
+	return mSharedVariablesLookup.find(name) != mSharedVariablesLookup.end();
+}
+
+const sSamplerState* CEffect::FindSamplerState(std::string_view name) const
 {
-	outEntrypoints.clear();
+	auto e = mSamplerStatesLookup.find(name);
+	return e != mSamplerStatesLookup.end() ? &mSamplerStates[e->second] : nullptr;
+}
 
-	for (auto& t : mTechniques)
+CCodeBlob::CCodeBlob(const void* data, uint32_t size)
+	: mData(nullptr), mSize(size)
+{
+	if (data && size > 0)
 	{
-		for (auto& p : t.Passes)
-		{
-			const std::string& shader = p.Shaders[static_cast<int>(type)];
-			if (!shader.empty() && shader != CEffect::NullProgramName)
-			{
-				outEntrypoints.insert(shader);
-			}
-		}
+		mData = std::make_unique<uint8_t[]>(size);
+		memcpy(mData.get(), data, mSize);
 	}
 }
 
-void CEffect::GetPassPrograms(const sTechniquePass& pass, uint8_t outPrograms[static_cast<size_t>(eProgramType::NumberOfTypes)]) const
+void CCodeBlob::EnsureReflection()
 {
-	std::set<std::string> programs;
-
-	for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
+	std::call_once(mReflectionOnce, [this]()
 	{
-		eProgramType type = static_cast<eProgramType>(i);
-		GetUsedPrograms(programs, type);
-
-		const std::string& programName = pass.Shaders[i];
-
-		auto e = programs.find(programName);
-		if (e == programs.end())
+		if (!mReflection)
 		{
-			outPrograms[i] = 0; // NULL program
+			mReflection = std::make_unique<sProgramReflection>(ReflectProgram(*this));
 		}
-		else
-		{
-			ptrdiff_t index = std::distance(programs.begin(), e) + 1; // +1 because first program is NULL program which is not returned by GetUsedPrograms
-			if (index > std::numeric_limits<uint8_t>::max())
-			{
-				throw std::runtime_error("Program index too big");
-			}
+	});
+}
 
-			outPrograms[i] = static_cast<uint8_t>(index);
-		}
-	}
+void CCodeBlob::SetReflection(sProgramReflection reflection)
+{
+	mReflection = std::make_unique<sProgramReflection>(std::move(reflection));
 }
 
-CCodeBlob::CCodeBlob(const void* data, uint32_t size)
-	: mData(nullptr), mSize(size)
+const sProgramReflection& CCodeBlob::Reflection() const
 {
-	if (data && size > 0)
+	if (!mReflection)
 	{
-		mData = std::make_unique<uint8_t[]>(size);
-		memcpy_s(mData.get(), mSize, data, mSize);
+		throw std::logic_error("Program code has not been reflected");
 	}
+
+	return *mReflection;
 }
 
 bool sAssignment::IsSamplerStateAssignment(eAssignmentType type)
@@ -198,237 +429,298 @@ bool sAssignment::IsSamplerStateAssignment(eAssignmentType type)
 	}
 }
 
-sAssignment sAssignment::GetTechniquePassAssignment(const std::string& type, const std::string& value)
+sAssignment sAssignment::GetTechniquePassAssignment(std::string_view type, std::string_view value)
 {
 	sAssignment a = GetAssignment(type, value);
 	return !IsSamplerStateAssignment(a.Type) ?
 		a :
-		throw std::runtime_error("Invalid technique pass assignment type '" + type + "'");
+		throw std::runtime_error("Invalid technique pass assignment type '" + std::string(type) + "'");
 }
 
-sAssignment sAssignment::GetSamplerStateAssignment(const std::string& type, const std::string& value)
+sAssignment sAssignment::GetSamplerStateAssignment(std::string_view type, std::string_view value)
 {
 	sAssignment a = GetAssignment(type, value);
 	return IsSamplerStateAssignment(a.Type) ?
 		a :
-		throw std::runtime_error("Invalid sampler state assignment type '" + type + "'");
+		throw std::runtime_error("Invalid sampler state assignment type '" + std::string(type) + "'");
 }
 
-sAssignment sAssignment::GetAssignment(const std::string& type, const std::string& value)
+// Assignment tables, sorted by name at compile time so they are looked up with a binary search
+// without building any map at startup
+
+struct sNamedValue
 {
-	auto typeEntry = NameToType.find(type);
-	if (typeEntry == NameToType.end())
-	{
-		throw std::runtime_error("Unknown assignment type '" + type + "'");
-	}
+	std::string_view Name;
+	uint32_t Value;
+};
 
-	eAssignmentType typeId = typeEntry->second;
+// Values an assignment type accepts, sorted by name. Empty if it accepts any integer.
+struct sNamedValueTable
+{
+	const sNamedValue* Begin = nullptr;
+	const sNamedValue* End = nullptr;
 
-	auto validAssignmentsEntry = sAssignment::ValidAssignments.find(typeId);
-	if (validAssignmentsEntry == sAssignment::ValidAssignments.end())
-	{
-		throw std::runtime_error("Unknown assignment type id '" + std::to_string(static_cast<uint32_t>(typeId)) + "' ('" + type + "')");
-	}
+	constexpr sNamedValueTable() = default;
+	template<size_t N>
+	constexpr sNamedValueTable(const sNamedValue (&values)[N]) : Begin(values), End(values + N) {}
 
-	uint32_t rawValue = 0;
-	const sAssignmentValues& validAssignments = validAssignmentsEntry->second;
-	if (validAssignments.NamedValues.empty())
-	{
-		constexpr const char* HexPrefix = "0x";
+	constexpr bool Empty() const { return Begin == End; }
 
-		// parse a decimal or hexadecimal value
-		int base = 10;
-		if (value.compare(0, strlen(HexPrefix), HexPrefix) == 0) // is hex
+	constexpr bool IsSorted() const
+	{
+		for (const sNamedValue* v = Begin; v != End && v + 1 != End; v++)
 		{
-			base = 16;
+			if (!(v[0].Name < v[1].Name))
+			{
+				return false;
+			}
 		}
-
-		rawValue = std::stoul(value, nullptr, base);
+		return true;
 	}
-	else
+
+	constexpr const sNamedValue* Find(std::string_view name) const
 	{
-		// find the value for the name
-		auto valueEntry = validAssignments.NamedValues.find(value);
-		if (valueEntry == validAssignments.NamedValues.end())
+		const sNamedValue* first = Begin;
+		const sNamedValue* last = End;
+		while (first < last)
 		{
-			throw std::runtime_error("Unknown value '" + value + "' for type '" + type + "'");
+			const sNamedValue* mid = first + (last - first) / 2;
+			const int c = mid->Name.compare(name);
+			if (c == 0)
+			{
+				return mid;
+			}
+			else if (c < 0)
+			{
+				first = mid + 1;
+			}
+			else
+			{
+				last = mid;
+			}
 		}
-
-		rawValue = valueEntry->second;
+		return nullptr;
 	}
+};
 
-	return { typeId, rawValue };
-}
+static constexpr sNamedValue FillModeValues[] =
+{
+	{ "SOLID",		D3D11_FILL_SOLID },
+	{ "WIREFRAME",	D3D11_FILL_WIREFRAME },
+};
 
-const sAssignmentValues sAssignmentValues::Any =
+static constexpr sNamedValue CullModeValues[] =
 {
-	{
-		// empty
-	}
+	{ "BACK",	D3D11_CULL_BACK },
+	{ "FRONT",	D3D11_CULL_FRONT },
+	{ "NONE",	D3D11_CULL_NONE },
 };
 
-const sAssignmentValues sAssignmentValues::FillMode =
+static constexpr sNamedValue BoolValues[] =
 {
-	{
-		{ "WIREFRAME",	D3D11_FILL_WIREFRAME },
-		{ "SOLID",		D3D11_FILL_SOLID },
-	}
+	{ "FALSE",	false },
+	{ "TRUE",	true },
 };
 
-const sAssignmentValues sAssignmentValues::CullMode =
+static constexpr sNamedValue DepthWriteMaskValues[] =
 {
-	{
-		{ "NONE",	D3D11_CULL_NONE },
-		{ "FRONT",	D3D11_CULL_FRONT },
-		{ "BACK",	D3D11_CULL_BACK },
-	}
+	{ "ALL",	D3D11_DEPTH_WRITE_MASK_ALL },
+	{ "ZERO",	D3D11_DEPTH_WRITE_MASK_ZERO },
 };
 
-const sAssignmentValues sAssignmentValues::Bool =
+static constexpr sNamedValue ComparisonFuncValues[] =
 {
-	{
-		{ "FALSE",	false },
-		{ "TRUE",	true },
-	}
+	{ "ALWAYS",			D3D11_COMPARISON_ALWAYS },
+	{ "EQUAL",			D3D11_COMPARISON_EQUAL },
+	{ "GREATER",		D3D11_COMPARISON_GREATER },
+	{ "GREATER_EQUAL",	D3D11_COMPARISON_GREATER_EQUAL },
+	{ "LESS",			D3D11_COMPARISON_LESS },
+	{ "LESS_EQUAL",		D3D11_COMPARISON_LESS_EQUAL },
+	{ "NEVER",			D3D11_COMPARISON_NEVER },
+	{ "NOT_EQUAL",		D3D11_COMPARISON_NOT_EQUAL },
 };
 
-const sAssignmentValues sAssignmentValues::DepthWriteMask =
+static constexpr sNamedValue StencilOpValues[] =
 {
-	{
-		{ "ZERO",	D3D11_DEPTH_WRITE_MASK_ZERO },
-		{ "ALL",	D3D11_DEPTH_WRITE_MASK_ALL },
-	}
+	{ "DECR",		D3D11_STENCIL_OP_DECR },
+	{ "DECR_SAT",	D3D11_STENCIL_OP_DECR_SAT },
+	{ "INCR",		D3D11_STENCIL_OP_INCR },
+	{ "INCR_SAT",	D3D11_STENCIL_OP_INCR_SAT },
+	{ "INVERT",		D3D11_STENCIL_OP_INVERT },
+	{ "KEEP",		D3D11_STENCIL_OP_KEEP },
+	{ "REPLACE",	D3D11_STENCIL_OP_REPLACE },
+	{ "ZERO",		D3D11_STENCIL_OP_ZERO },
 };
 
-const sAssignmentValues sAssignmentValues::ComparisonFunc =
+static constexpr sNamedValue BlendValues[] =
 {
-	{
-		{ "NEVER",			D3D11_COMPARISON_NEVER },
-		{ "LESS",			D3D11_COMPARISON_LESS },
-		{ "EQUAL",			D3D11_COMPARISON_EQUAL },
-		{ "LESS_EQUAL",		D3D11_COMPARISON_LESS_EQUAL },
-		{ "GREATER",		D3D11_COMPARISON_GREATER },
-		{ "NOT_EQUAL",		D3D11_COMPARISON_NOT_EQUAL },
-		{ "GREATER_EQUAL",	D3D11_COMPARISON_GREATER_EQUAL },
-		{ "ALWAYS",			D3D11_COMPARISON_ALWAYS },
-	}
+	{ "BLEND_FACTOR",		D3D11_BLEND_BLEND_FACTOR },
+	{ "DEST_ALPHA",			D3D11_BLEND_DEST_ALPHA },
+	{ "DEST_COLOR",			D3D11_BLEND_DEST_COLOR },
+	{ "INV_BLEND_FACTOR",	D3D11_BLEND_INV_BLEND_FACTOR },
+	{ "INV_DEST_ALPHA",		D3D11_BLEND_INV_DEST_ALPHA },
+	{ "INV_DEST_COLOR",		D3D11_BLEND_INV_DEST_COLOR },
+	{ "INV_SRC1_ALPHA",		D3D11_BLEND_INV_SRC1_ALPHA },
+	{ "INV_SRC1_COLOR",		D3D11_BLEND_INV_SRC1_COLOR },
+	{ "INV_SRC_ALPHA",		D3D11_BLEND_INV_SRC_ALPHA },
+	{ "INV_SRC_COLOR",		D3D11_BLEND_INV_SRC_COLOR },
+	{ "ONE",				D3D11_BLEND_ONE },
+	{ "SRC1_ALPHA",			D3D11_BLEND_SRC1_ALPHA },
+	{ "SRC1_COLOR",			D3D11_BLEND_SRC1_COLOR },
+	{ "SRC_ALPHA",			D3D11_BLEND_SRC_ALPHA },
+	{ "SRC_ALPHA_SAT",		D3D11_BLEND_SRC_ALPHA_SAT },
+	{ "SRC_COLOR",			D3D11_BLEND_SRC_COLOR },
+	{ "ZERO",				D3D11_BLEND_ZERO },
 };
 
-const sAssignmentValues sAssignmentValues::StencilOp =
+static constexpr sNamedValue BlendOpValues[] =
 {
-	{
-		{ "KEEP",		D3D11_STENCIL_OP_KEEP },
-		{ "ZERO",		D3D11_STENCIL_OP_ZERO },
-		{ "REPLACE",	D3D11_STENCIL_OP_REPLACE },
-		{ "INCR_SAT",	D3D11_STENCIL_OP_INCR_SAT },
-		{ "DECR_SAT",	D3D11_STENCIL_OP_DECR_SAT },
-		{ "INVERT",		D3D11_STENCIL_OP_INVERT },
-		{ "INCR",		D3D11_STENCIL_OP_INCR },
-		{ "DECR",		D3D11_STENCIL_OP_DECR },
-	}
+	{ "ADD",			D3D11_BLEND_OP_ADD },
+	{ "MAX",			D3D11_BLEND_OP_MAX },
+	{ "MIN",			D3D11_BLEND_OP_MIN },
+	{ "REV_SUBTRACT",	D3D11_BLEND_OP_REV_SUBTRACT },
+	{ "SUBTRACT",		D3D11_BLEND_OP_SUBTRACT },
 };
 
-const sAssignmentValues sAssignmentValues::Blend =
-{
-	{
-		{ "ZERO",				D3D11_BLEND_ZERO },
-		{ "ONE",				D3D11_BLEND_ONE },
-		{ "SRC_COLOR",			D3D11_BLEND_SRC_COLOR },
-		{ "INV_SRC_COLOR",		D3D11_BLEND_INV_SRC_COLOR },
-		{ "SRC_ALPHA",			D3D11_BLEND_SRC_ALPHA },
-		{ "INV_SRC_ALPHA",		D3D11_BLEND_INV_SRC_ALPHA },
-		{ "DEST_ALPHA",			D3D11_BLEND_DEST_ALPHA },
-		{ "INV_DEST_ALPHA",		D3D11_BLEND_INV_DEST_ALPHA },
-		{ "DEST_COLOR",			D3D11_BLEND_DEST_COLOR },
-		{ "INV_DEST_COLOR",		D3D11_BLEND_INV_DEST_COLOR },
-		{ "SRC_ALPHA_SAT",		D3D11_BLEND_SRC_ALPHA_SAT },
-		{ "BLEND_FACTOR",		D3D11_BLEND_BLEND_FACTOR },
-		{ "INV_BLEND_FACTOR",	D3D11_BLEND_INV_BLEND_FACTOR },
-		{ "SRC1_COLOR",			D3D11_BLEND_SRC1_COLOR },
-		{ "INV_SRC1_COLOR",		D3D11_BLEND_INV_SRC1_COLOR },
-		{ "SRC1_ALPHA",			D3D11_BLEND_SRC1_ALPHA },
-		{ "INV_SRC1_ALPHA",		D3D11_BLEND_INV_SRC1_ALPHA },
-	}
+static constexpr sNamedValue TextureAddressModeValues[] =
+{
+	{ "BORDER",			D3D11_TEXTURE_ADDRESS_BORDER },
+	{ "CLAMP",			D3D11_TEXTURE_ADDRESS_CLAMP },
+	{ "MIRROR",			D3D11_TEXTURE_ADDRESS_MIRROR },
+	{ "MIRROR_ONCE",	D3D11_TEXTURE_ADDRESS_MIRROR_ONCE },
+	{ "WRAP",			D3D11_TEXTURE_ADDRESS_WRAP },
+};
+
+static constexpr sNamedValueTable AnyValue = {};
+
+struct sAssignmentTypeDesc
+{
+	std::string_view Name;
+	eAssignmentType Type;
+	sNamedValueTable Values;
+};
+
+// sorted by name
+static constexpr sAssignmentTypeDesc AssignmentTypes[] =
+{
+	{ "AddressU",					eAssignmentType::AddressU,					TextureAddressModeValues },
+	{ "AddressV",					eAssignmentType::AddressV,					TextureAddressModeValues },
+	{ "AddressW",					eAssignmentType::AddressW,					TextureAddressModeValues },
+	{ "AlphaToCoverageEnable",		eAssignmentType::AlphaToCoverageEnable,		BoolValues },
+	{ "BlendEnable0",				eAssignmentType::BlendEnable0,				BoolValues },
+	{ "BlendOp0",					eAssignmentType::BlendOp0,					BlendOpValues },
+	{ "CullMode",					eAssignmentType::CullMode,					CullModeValues },
+	{ "DepthEnable",				eAssignmentType::DepthEnable,				BoolValues },
+	{ "DepthFunc",					eAssignmentType::DepthFunc,					ComparisonFuncValues },
+	{ "DepthWriteMask",				eAssignmentType::DepthWriteMask,			DepthWriteMaskValues },
+	{ "DestBlend0",					eAssignmentType::DestBlend0,				BlendValues },
+	{ "FillMode",					eAssignmentType::FillMode,					FillModeValues },
+	{ "FrontFaceStencilDepthFail",	eAssignmentType::FrontFaceStencilDepthFail,	StencilOpValues },
+	{ "FrontFaceStencilFail",		eAssignmentType::FrontFaceStencilFail,		StencilOpValues },
+	{ "FrontFaceStencilFunc",		eAssignmentType::FrontFaceStencilFunc,		ComparisonFuncValues },
+	{ "FrontFaceStencilPass",		eAssignmentType::FrontFaceStencilPass,		StencilOpValues },
+	{ "RenderTargetWriteMask0",		eAssignmentType::RenderTargetWriteMask0,	AnyValue },
+	{ "SrcBlend0",					eAssignmentType::SrcBlend0,					BlendValues },
+	{ "StencilEnable",				eAssignmentType::StencilEnable,				BoolValues },
+	{ "StencilReadMask",			eAssignmentType::StencilReadMask,			AnyValue },
+	{ "StencilWriteMask",			eAssignmentType::StencilWriteMask,			AnyValue },
 };
 
-const sAssignmentValues sAssignmentValues::BlendOp =
+static constexpr bool AreAssignmentTablesSorted()
 {
+	for (size_t i = 0; i < std::size(AssignmentTypes); i++)
 	{
-		{ "ADD",			D3D11_BLEND_OP_ADD },
-		{ "SUBTRACT",		D3D11_BLEND_OP_SUBTRACT },
-		{ "REV_SUBTRACT",	D3D11_BLEND_OP_REV_SUBTRACT },
-		{ "MIN",			D3D11_BLEND_OP_MIN },
-		{ "MAX",			D3D11_BLEND_OP_MAX },
+		if (!AssignmentTypes[i].Values.IsSorted() ||
+			(i > 0 && !(AssignmentTypes[i - 1].Name < AssignmentTypes[i].Name)))
+		{
+			return false;
+		}
 	}
-};
+	return true;
+}
 
-const sAssignmentValues sAssignmentValues::TextureAddressMode =
+static_assert(AreAssignmentTablesSorted(), "Assignment tables must be sorted by name");
+
+static constexpr const sAssignmentTypeDesc* FindAssignmentType(std::string_view name)
 {
+	size_t first = 0;
+	size_t last = std::size(AssignmentTypes);
+	while (first < last)
 	{
-		{ "WRAP",			D3D11_TEXTURE_ADDRESS_WRAP },
-		{ "MIRROR",			D3D11_TEXTURE_ADDRESS_MIRROR },
-		{ "CLAMP",			D3D11_TEXTURE_ADDRESS_CLAMP },
-		{ "BORDER",			D3D11_TEXTURE_ADDRESS_BORDER },
-		{ "MIRROR_ONCE",	D3D11_TEXTURE_ADDRESS_MIRROR_ONCE },
+		const size_t mid = first + (last - first) / 2;
+		const int c = AssignmentTypes[mid].Name.compare(name);
+		if (c == 0)
+		{
+			return &AssignmentTypes[mid];
+		}
+		else if (c < 0)
+		{
+			first = mid + 1;
+		}
+		else
+		{
+			last = mid;
+		}
 	}
-};
+	return nullptr;
+}
 
-const std::unordered_map<eAssignmentType, sAssignmentValues> sAssignment::ValidAssignments =
-{
-	{ eAssignmentType::FillMode,					sAssignmentValues::FillMode },
-	{ eAssignmentType::CullMode,					sAssignmentValues::CullMode },
-	{ eAssignmentType::DepthEnable,					sAssignmentValues::Bool },
-	{ eAssignmentType::DepthWriteMask,				sAssignmentValues::DepthWriteMask },
-	{ eAssignmentType::DepthFunc,					sAssignmentValues::ComparisonFunc },
-	{ eAssignmentType::StencilEnable,				sAssignmentValues::Bool },
-	{ eAssignmentType::StencilReadMask,				sAssignmentValues::Any },
-	{ eAssignmentType::StencilWriteMask,			sAssignmentValues::Any },
-	{ eAssignmentType::FrontFaceStencilFail,		sAssignmentValues::StencilOp },
-	{ eAssignmentType::FrontFaceStencilDepthFail,	sAssignmentValues::StencilOp },
-	{ eAssignmentType::FrontFaceStencilPass,		sAssignmentValues::StencilOp },
-	{ eAssignmentType::FrontFaceStencilFunc,		sAssignmentValues::ComparisonFunc },
-	{ eAssignmentType::AlphaToCoverageEnable,		sAssignmentValues::Bool },
-	{ eAssignmentType::BlendEnable0,				sAssignmentValues::Bool },
-	{ eAssignmentType::SrcBlend0,					sAssignmentValues::Blend },
-	{ eAssignmentType::DestBlend0,					sAssignmentValues::Blend },
-	{ eAssignmentType::BlendOp0,					sAssignmentValues::BlendOp },
-	{ eAssignmentType::RenderTargetWriteMask0,		sAssignmentValues::Any },
-	{ eAssignmentType::AddressU,					sAssignmentValues::TextureAddressMode },
-	{ eAssignmentType::AddressV,					sAssignmentValues::TextureAddressMode },
-	{ eAssignmentType::AddressW,					sAssignmentValues::TextureAddressMode },
-};
+static_assert(FindAssignmentType("DepthFunc")->Values.Find("LESS_EQUAL")->Value == D3D11_COMPARISON_LESS_EQUAL);
+static_assert(FindAssignmentType("StencilReadMask")->Values.Empty());
+static_assert(FindAssignmentType("Unknown") == nullptr);
 
-const std::unordered_map<std::string_view, eAssignmentType> sAssignment::NameToType =
-{
-	{ "FillMode",					eAssignmentType::FillMode },
-	{ "CullMode",					eAssignmentType::CullMode },
-	{ "DepthEnable",				eAssignmentType::DepthEnable },
-	{ "DepthWriteMask",				eAssignmentType::DepthWriteMask },
-	{ "DepthFunc",					eAssignmentType::DepthFunc },
-	{ "StencilEnable",				eAssignmentType::StencilEnable },
-	{ "StencilReadMask",			eAssignmentType::StencilReadMask },
-	{ "StencilWriteMask",			eAssignmentType::StencilWriteMask },
-	{ "FrontFaceStencilFail",		eAssignmentType::FrontFaceStencilFail },
-	{ "FrontFaceStencilDepthFail",	eAssignmentType::FrontFaceStencilDepthFail },
-	{ "FrontFaceStencilPass",		eAssignmentType::FrontFaceStencilPass },
-	{ "FrontFaceStencilFunc",		eAssignmentType::FrontFaceStencilFunc },
-	{ "AlphaToCoverageEnable",		eAssignmentType::AlphaToCoverageEnable },
-	{ "BlendEnable0",				eAssignmentType::BlendEnable0 },
-	{ "SrcBlend0",					eAssignmentType::SrcBlend0 },
-	{ "DestBlend0",					eAssignmentType::DestBlend0 },
-	{ "BlendOp0",					eAssignmentType::BlendOp0 },
-	{ "RenderTargetWriteMask0",		eAssignmentType::RenderTargetWriteMask0 },
-	{ "AddressU",					eAssignmentType::AddressU },
-	{ "AddressV",					eAssignmentType::AddressV },
-	{ "AddressW",					eAssignmentType::AddressW },
-};
+std::string_view sAssignment::GetTypeName(eAssignmentType type)
+{
+	for (const sAssignmentTypeDesc& t : AssignmentTypes)
+	{
+		if (t.Type == type)
+		{
+			return t.Name;
+		}
+	}
+	return {};
+}
 
-const std::unordered_map<eAssignmentType, std::string_view> sAssignment::TypeToName = []()
+sAssignment sAssignment::GetAssignment(std::string_view type, std::string_view value)
 {
-	std::unordered_map<eAssignmentType, std::string_view> tmpMap;
-	for (auto& e : sAssignment::NameToType)
+	const sAssignmentTypeDesc* typeDesc = FindAssignmentType(type);
+	if (!typeDesc)
 	{
-		tmpMap.insert({ e.second, e.first });
+		throw std::runtime_error("Unknown assignment type '" + std::string(type) + "'");
 	}
-	return tmpMap;
-}();
+
+	uint32_t rawValue = 0;
+	if (typeDesc->Values.Empty())
+	{
+		constexpr std::string_view HexPrefix = "0x";
+
+		// parse a decimal or hexadecimal value
+		int base = 10;
+		std::string_view digits = value;
+		if (digits.compare(0, HexPrefix.size(), HexPrefix) == 0) // is hex
+		{
+			base = 16;
+			digits.remove_prefix(HexPrefix.size());
+		}
+
+		const char* digitsEnd = digits.data() + digits.size();
+		const auto r = std::from_chars(digits.data(), digitsEnd, rawValue, base);
+		if (r.ec != std::errc() || r.ptr != digitsEnd)
+		{
+			throw std::runtime_error("Invalid value '" + std::string(value) + "' for type '" + std::string(type) + "'");
+		}
+	}
+	else
+	{
+		// find the value for the name
+		const sNamedValue* namedValue = typeDesc->Values.Find(value);
+		if (!namedValue)
+		{
+			throw std::runtime_error("Unknown value '" + std::string(value) + "' for type '" + std::string(type) + "'");
+		}
+
+		rawValue = namedValue->Value;
+	}
+
+	return { typeDesc->Type, rawValue };
+}
@@ -1,18 +1,25 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>
 #include <filesystem>
 #include <optional>
-#include "EffectInclude.h"
+#include <mutex>
+#include "EffectReflection.h"
+#include "Hash.h"
 
 struct sTechniquePassAssigment;
 struct sTechniquePass;
 struct sTechnique;
 struct sSamplerState;
 class CCodeBlob;
+class CCodeCache;
+class CCodeInterner;
+class CIncludeCache;
 
 enum class eProgramType
 {
@@ -28,40 +35,94 @@ enum class eProgramType
 	NumberOfTypes,
 };
 
+struct sEffectDefine
+{
+	std::string Name;
+	std::string Value;
+};
+
+struct sEffectOptions
+{
+	uint32_t NumJobs = 1; // number of programs compiled in parallel, large sources are also parsed with this many threads
+	CCodeCache* Cache = nullptr; // if set, compiled programs are looked up and stored here
+	CIncludeCache* IncludeCache = nullptr; // if set, include files are read through it, so they can be shared with other effects
+	CCodeInterner* Interner = nullptr; // if set, compiled programs with identical bytecode are shared with other effects
+	std::vector<sEffectDefine> Defines; // macros defined before preprocessing the source
+	// if not empty, only the techniques whose name matches one of these patterns ('*' and '?' wildcards) are
+	// kept, and only the programs they use are compiled. For development builds. It is an error if the effect
+	// has techniques and none of them matches.
+	std::vector<std::string> Techniques;
+};
+
 class CEffect
 {
 private:
 	std::string mSource;
+	std::shared_ptr<const void> mPreprocessedSourceOwner; // the buffer returned by the preprocessor, not copied
+	std::string_view mPreprocessedSource; // view of mPreprocessedSourceOwner, the names parsed from it are views of it too
+	bool mSourcePreprocessed; // mPreprocessedSource may be empty once preprocessed
+	std::shared_ptr<const void> mInternedSource; // identifies the preprocessed source in sEffectOptions::Interner, see CCodeInterner::InternSource
 	std::filesystem::path mSourceFilename;
 	std::vector<sTechnique> mTechniques;
-	std::vector<std::string> mSharedVariables;
+	bool mTechniquesParsed; // mTechniques may be empty once parsed
+	std::vector<std::string_view> mPrograms[static_cast<size_t>(eProgramType::NumberOfTypes)];
+	std::vector<std::string_view> mSharedVariables;
+	std::unordered_set<std::string_view> mSharedVariablesLookup;
 	std::vector<sSamplerState> mSamplerStates;
-	std::unordered_map<std::string, std::unique_ptr<CCodeBlob>> mProgramsCode;
-	std::unique_ptr<CEffectInclude> mInclude;
+	std::unordered_map<std::string_view, size_t> mSamplerStatesLookup; // name -> index in mSamplerStates
+	std::unordered_map<std::string, std::shared_ptr<CCodeBlob>> mProgramsCode; // may be shared with other effects, see sEffectOptions::Interner
+	std::vector<std::filesystem::path> mIncludeDirectories;
+	std::set<std::filesystem::path> mIncludedFiles;
+	sEffectOptions mOptions;
 
 public:
-	CEffect(const std::string& source, const std::filesystem::path& sourceFilename, const std::vector<std::filesystem::path>& includeDirs);
+	CEffect(const std::string& source, const std::filesystem::path& sourceFilename, const std::vector<std::filesystem::path>& includeDirs, const sEffectOptions& options = {});
 
-	void GetUsedPrograms(std::set<std::string>& outEntrypoints, eProgramType type) const;
 	const CCodeBlob& GetProgramCode(const std::string& entrypoint) const;
-	void GetPassPrograms(const sTechniquePass& pass, uint8_t outPrograms[static_cast<size_t>(eProgramType::NumberOfTypes)]) const;
-	std::string PreprocessSource() const;
+	// Returns the preprocessed source, which is valid as long as `outOwner` is kept.
+	// outIncludedFiles: if not null, receives the files included by the source
+	std::string_view PreprocessSource(std::shared_ptr<const void>& outOwner, std::set<std::filesystem::path>* outIncludedFiles = nullptr) const;
 
 	inline const std::string& Source() const { return mSource; }
+	inline std::string_view PreprocessedSource() const { return mPreprocessedSource; }
+	// Keeps PreprocessedSource alive, even after the effect is destroyed
+	inline const std::shared_ptr<const void>& PreprocessedSourceOwner() const { return mPreprocessedSourceOwner; }
 	inline const std::filesystem::path& SourceFilename() const { return mSourceFilename; }
 	inline const std::vector<sTechnique>& Techniques() const { return mTechniques; }
-	inline const std::vector<std::string>& SharedVariables() const { return mSharedVariables; }
+	// Names of the programs of this type used by the passes, sorted. The passes refer to them by their index + 1.
+	inline const std::vector<std::string_view>& Programs(eProgramType type) const { return mPrograms[static_cast<size_t>(type)]; }
+	inline const std::vector<std::string_view>& SharedVariables() const { return mSharedVariables; }
 	inline const std::vector<sSamplerState>& SamplerStates() const { return mSamplerStates; }
+	// Files included by the source, valid once the source is preprocessed
+	inline const std::set<std::filesystem::path>& IncludedFiles() const { return mIncludedFiles; }
+	bool IsSharedVariable(std::string_view name) const;
+	const sSamplerState* FindSamplerState(std::string_view name) const;
 
 	static const char* GetTargetForProgram(eProgramType type);
 	static const char* GetAssignmentTypeForProgram(eProgramType type);
 
 	static constexpr const char* NullProgramName = "NULL";
-private:
+
+	// Stages of the compilation, each one runs the previous stages it depends on and does nothing
+	// if it already ran. The accessors above only return valid data once the related stage ran.
+	void EnsurePreprocessedSource();
 	void EnsureTechniques();
 	void EnsureProgramsCode();
+	void EnsureProgramsReflection();
 
-	std::unique_ptr<CCodeBlob> CompileProgram(const std::string& entryPoint, eProgramType type) const;
+	// Provide the results of a stage computed elsewhere, so the stage is not run. For platforms
+	// without the D3D compiler and for benchmarks.
+	// Must be called before the techniques are parsed, they keep views of the previous source.
+	void SetPreprocessedSource(std::string preprocessedSource);
+	// EnsureProgramsCode only compiles the programs whose code wasn't set
+	void SetProgramCode(const std::string& entrypoint, std::unique_ptr<CCodeBlob> code);
+
+private:
+
+	// sourceHash: CCodeCache::HashSource of the preprocessed source, only needed with a cache or an interner
+	std::shared_ptr<CCodeBlob> CompileProgram(const std::string& entryPoint, eProgramType type, const tSha256Digest& sourceHash) const;
+	// Removes the techniques that don't match sEffectOptions::Techniques and the programs only they use
+	void FilterTechniques();
 };
 
 enum class eAssignmentType : uint32_t
@@ -106,51 +167,39 @@ enum class eAssignmentType : uint32_t
 	AddressW = SamplerStateOffset + 2,
 };
 
-struct sAssignmentValues
-{
-	std::unordered_map<std::string_view, uint32_t> NamedValues;
-
-	static const sAssignmentValues Any, FillMode, CullMode, Bool, DepthWriteMask,
-								ComparisonFunc, StencilOp, Blend, BlendOp,
-								TextureAddressMode;
-};
-
 struct sAssignment
 {
 	eAssignmentType Type;
 	uint32_t Value;
 
-	static const std::unordered_map<eAssignmentType, sAssignmentValues> ValidAssignments;
-	static const std::unordered_map<std::string_view, eAssignmentType> NameToType;
-	static const std::unordered_map<eAssignmentType, std::string_view> TypeToName;
-
 	static bool IsSamplerStateAssignment(eAssignmentType type);
-	static sAssignment GetTechniquePassAssignment(const std::string& type, const std::string& value);
-	static sAssignment GetSamplerStateAssignment(const std::string& type, const std::string& value);
+	// Returns the name used in the source for the type, or an empty string if the type is unknown
+	static std::string_view GetTypeName(eAssignmentType type);
+	static sAssignment GetTechniquePassAssignment(std::string_view type, std::string_view value);
+	static sAssignment GetSamplerStateAssignment(std::string_view type, std::string_view value);
 
 private:
-	static sAssignment GetAssignment(const std::string& type, const std::string& value);
+	static sAssignment GetAssignment(std::string_view type, std::string_view value);
 };
 
+// The names are views of the preprocessed source they were parsed from
+
 struct sTechniquePass
 {
-	std::string Shaders[static_cast<size_t>(eProgramType::NumberOfTypes)] =
-	{
-		CEffect::NullProgramName, CEffect::NullProgramName, CEffect::NullProgramName,
-		CEffect::NullProgramName, CEffect::NullProgramName, CEffect::NullProgramName,
-	};
+	// index of the program of each type in CEffect::Programs + 1, 0 is the NULL program. Same as the indices in the .fxc file.
+	uint16_t Programs[static_cast<size_t>(eProgramType::NumberOfTypes)] = {};
 	std::vector<sAssignment> Assignments;
 };
 
 struct sTechnique
 {
-	std::string Name;
+	std::string_view Name;
 	std::vector<sTechniquePass> Passes;
 };
 
 struct sSamplerState
 {
-	std::string Name;
+	std::string_view Name;
 	std::vector<sAssignment> Assignments;
 };
 
@@ -159,10 +208,17 @@ class CCodeBlob
 private:
 	std::unique_ptr<uint8_t[]> mData;
 	uint32_t mSize;
+	std::unique_ptr<sProgramReflection> mReflection;
+	std::once_flag mReflectionOnce;
 
 public:
 	CCodeBlob(const void* data, uint32_t size);
 
 	inline const uint8_t* Data() const { return mData.get(); }
 	inline uint32_t Size() const { return mSize; }
+
+	// Reflects the code if it wasn't reflected yet. Thread-safe, the code may be shared by multiple effects.
+	void EnsureReflection();
+	void SetReflection(sProgramReflection reflection);
+	const sProgramReflection& Reflection() const;
 };
@@ -0,0 +1,695 @@
+#include "EffectCompiler.h"
+#include <ctype.h>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include "CodeCache.h"
+#include "Effect.h"
+#include "EffectSaver.h"
+#include "FileWatcher.h"
+#include "Hash.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "Wildcard.h"
+
+namespace fs = std::filesystem;
+
+// Outputs of the jobs of a batch, by input file and the hash of their preprocessed source. The compiled programs
+// only depend on the preprocessed source, so jobs with the same one have the same output. The #line directives
+// make the preprocessed sources of different input files different, so only the variants of an input file are
+// compared, and the sources are released once all its jobs are done.
+struct CEffectCompiler::sSharedOutputs
+{
+	struct sOutput
+	{
+		const sCompileJob* Job = nullptr;	// the job that compiled the source
+		bool Succeeded = false;
+		std::shared_ptr<const void> SourceOwner;
+		std::string_view Source;			// compared before reusing the output, the hash may collide
+	};
+
+	struct sInput
+	{
+		size_t RemainingJobs = 0;
+		std::unordered_map<uint64_t, std::shared_future<sOutput>> Outputs;
+	};
+
+	std::mutex Mutex;
+	std::map<fs::path, sInput> Inputs;
+};
+
+// Upper limit of the variants of a define matrix, to catch matrices with too many axes
+static constexpr size_t MaxVariants = 65536;
+
+CEffectCompiler::CEffectCompiler(const sCompilerOptions& options)
+	: mOptions(options), mIncludeCache(options.MapIncludeFiles), mCodeInterner(options.RecordDuplicatePrograms)
+{
+}
+
+// The input file and the defines of the job, so the variants of an effect can be told apart
+static std::string DescribeJob(const sCompileJob& job)
+{
+	std::string description = "'" + job.InputPath.string() + "'";
+	if (!job.Defines.empty())
+	{
+		description += " (";
+		for (size_t i = 0; i < job.Defines.size(); i++)
+		{
+			description += (i > 0 ? " " : "") + job.Defines[i].Name + "=" + job.Defines[i].Value;
+		}
+		description += ")";
+	}
+	return description;
+}
+
+// Detects jobs that would overwrite each other before compiling anything
+static void CheckBatchOutputs(const std::vector<sCompileJob>& jobs, eCompileMode mode)
+{
+	if (mode == eCompileMode::Validate)
+	{
+		return;
+	}
+
+	std::set<fs::path> outputs;
+	for (const auto& j : jobs)
+	{
+		if (!outputs.insert(j.OutputPath).second)
+		{
+			throw std::invalid_argument("Multiple inputs have the same output file '" + j.OutputPath.string() + "'");
+		}
+	}
+}
+
+bool CEffectCompiler::Compile(const sCompileJob& job, uint32_t numJobs)
+{
+	if (IsUpToDate(job))
+	{
+		return false;
+	}
+
+	CTraceScope trace("effect", job.InputPath.filename().string());
+	std::unique_ptr<CEffect> fx = LoadEffect(job, numJobs);
+	Save(*fx, job.OutputPath);
+	WriteDepfile(*fx, job);
+	return true;
+}
+
+size_t CEffectCompiler::CompileBatch(const std::vector<sCompileJob>& jobs, std::ostream& log)
+{
+	if (jobs.empty())
+	{
+		return 0;
+	}
+
+	CheckBatchOutputs(jobs, mOptions.Mode);
+
+	std::vector<size_t> indices(jobs.size());
+	std::iota(indices.begin(), indices.end(), size_t(0));
+	return CompileBatchJobs(jobs, indices, log, nullptr);
+}
+
+void CEffectCompiler::Watch(const std::vector<sCompileJob>& jobs, std::ostream& log)
+{
+	CheckBatchOutputs(jobs, mOptions.Mode);
+
+	std::vector<std::vector<fs::path>> dependencies(jobs.size());
+	std::vector<size_t> indices(jobs.size());
+	std::iota(indices.begin(), indices.end(), size_t(0));
+
+	CFileWatcher watcher;
+	while (true)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const size_t numFailed = CompileBatchJobs(jobs, indices, log, &dependencies);
+		const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		log << (indices.size() - numFailed) << " of " << indices.size() << " effects processed successfully in "
+			<< elapsed.count() << " ms, waiting for changes..." << std::endl;
+
+		// the process doesn't exit, so keep the cache below its maximum size after each compilation
+		if (mOptions.Cache)
+		{
+			mOptions.Cache->Trim();
+		}
+
+		std::map<fs::path, std::vector<size_t>> dependents;
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			for (const auto& d : dependencies[i])
+			{
+				dependents[d].push_back(i);
+			}
+		}
+
+		std::vector<fs::path> files;
+		for (const auto& [file, _] : dependents)
+		{
+			files.push_back(file);
+		}
+		watcher.SetFiles(files);
+
+		const std::vector<fs::path> changed = watcher.WaitForChanges();
+		mIncludeCache.Invalidate(changed);
+
+		std::set<size_t> affected;
+		for (const auto& f : changed)
+		{
+			log << "'" << f.string() << "' changed" << std::endl;
+			affected.insert(dependents[f].begin(), dependents[f].end());
+		}
+		indices.assign(affected.begin(), affected.end());
+	}
+}
+
+size_t CEffectCompiler::CompileBatchJobs(const std::vector<sCompileJob>& jobs, const std::vector<size_t>& indices, std::ostream& log, std::vector<std::vector<fs::path>>* outDependencies)
+{
+	if (indices.empty())
+	{
+		return 0;
+	}
+
+	// if there are less effects than jobs, the remaining jobs are used to compile the programs of each effect
+	const uint32_t numEffectJobs = indices.size() >= mOptions.NumJobs ? 1 : static_cast<uint32_t>(mOptions.NumJobs / indices.size());
+
+	sSharedOutputs sharedOutputs;
+	for (size_t i : indices)
+	{
+		sharedOutputs.Inputs[jobs[i].InputPath].RemainingJobs++;
+	}
+
+	std::mutex logMutex;
+	std::atomic<size_t> numFailed = 0;
+	ParallelFor(indices.size(), mOptions.NumJobs, [this, &jobs, &indices, &log, &logMutex, &numFailed, &sharedOutputs, numEffectJobs, outDependencies](size_t i)
+	{
+		const size_t jobIndex = indices[i];
+		std::string message;
+		if (!CompileBatchJob(jobs[jobIndex], numEffectJobs, sharedOutputs, message, outDependencies ? &(*outDependencies)[jobIndex] : nullptr))
+		{
+			numFailed++;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(sharedOutputs.Mutex);
+			auto input = sharedOutputs.Inputs.find(jobs[jobIndex].InputPath);
+			if (--input->second.RemainingJobs == 0)
+			{
+				sharedOutputs.Inputs.erase(input);
+			}
+		}
+
+		if (!message.empty())
+		{
+			std::lock_guard<std::mutex> lock(logMutex);
+			log << message << std::flush;
+		}
+	});
+
+	return numFailed;
+}
+
+bool CEffectCompiler::CompileBatchJob(const sCompileJob& job, uint32_t numJobs, sSharedOutputs& sharedOutputs, std::string& message, std::vector<fs::path>* outDependencies)
+{
+	std::unique_ptr<CEffect> fx;
+	std::optional<std::promise<sSharedOutputs::sOutput>> ownOutput; // set if other jobs may wait for this job's output
+	bool succeeded = true;
+	try
+	{
+		// the dependencies are only known after compiling
+		if (!outDependencies && IsUpToDate(job))
+		{
+			return true;
+		}
+
+		CTraceScope trace("effect", job.InputPath.filename().string());
+		fx = LoadEffect(job, numJobs);
+		std::shared_future<sSharedOutputs::sOutput> sharedOutput;
+		if (mOptions.Mode == eCompileMode::Compile)
+		{
+			fx->EnsureTechniques();
+			if (fx->Techniques().empty())
+			{
+				// most likely a file only meant to be included by other effects, e.g. rage_shared.fx
+				message = "Skipped " + DescribeJob(job) + ": no techniques\n";
+			}
+			else
+			{
+				// the first job with this source compiles it, the others wait for it
+				const uint64_t key = fnv1a64(fx->PreprocessedSource());
+				std::lock_guard<std::mutex> lock(sharedOutputs.Mutex);
+				auto [entry, inserted] = sharedOutputs.Inputs.at(job.InputPath).Outputs.try_emplace(key);
+				if (inserted)
+				{
+					entry->second = ownOutput.emplace().get_future().share();
+				}
+				else
+				{
+					sharedOutput = entry->second;
+				}
+			}
+		}
+
+		const sSharedOutputs::sOutput* output = sharedOutput.valid() ? &sharedOutput.get() : nullptr;
+		if (output && output->Source == fx->PreprocessedSource())
+		{
+			if (!output->Succeeded)
+			{
+				throw std::runtime_error("Same preprocessed source as " + DescribeJob(*output->Job) + ", which failed");
+			}
+
+			fs::copy_file(output->Job->OutputPath, job.OutputPath, fs::copy_options::overwrite_existing);
+			WriteDepfile(*fx, job);
+		}
+		else if (message.empty())
+		{
+			Save(*fx, job.OutputPath);
+			WriteDepfile(*fx, job);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		succeeded = false;
+		message = "Failed " + DescribeJob(job) + ":\n" + e.what() + "\n";
+	}
+
+	if (ownOutput)
+	{
+		ownOutput->set_value({ &job, succeeded, fx->PreprocessedSourceOwner(), fx->PreprocessedSource() });
+	}
+
+	if (outDependencies)
+	{
+		outDependencies->assign(1, fs::absolute(job.InputPath));
+		if (fx)
+		{
+			outDependencies->insert(outDependencies->end(), fx->IncludedFiles().begin(), fx->IncludedFiles().end());
+		}
+	}
+
+	return succeeded;
+}
+
+std::unique_ptr<CEffect> CEffectCompiler::LoadEffect(const sCompileJob& job, uint32_t numJobs)
+{
+	const fs::path& inputPath = job.InputPath;
+
+	if (!fs::exists(inputPath))
+	{
+		throw std::runtime_error("Path '" + inputPath.string() + "' does not exist");
+	}
+
+	if (!fs::is_regular_file(inputPath))
+	{
+		throw std::runtime_error("Path '" + inputPath.string() + "' does not refer to a file");
+	}
+
+	std::stringstream srcBuffer;
+	{
+		CTraceScope trace("read", inputPath.filename().string());
+		std::ifstream inputFile(inputPath);
+		srcBuffer << inputFile.rdbuf();
+	}
+
+	sEffectOptions options;
+	options.NumJobs = numJobs;
+	options.Cache = mOptions.Cache;
+	options.IncludeCache = &mIncludeCache;
+	options.Interner = &mCodeInterner;
+	options.Defines = mOptions.Defines;
+	options.Defines.insert(options.Defines.end(), job.Defines.begin(), job.Defines.end());
+	options.Techniques = mOptions.Techniques;
+	return std::make_unique<CEffect>(srcBuffer.str(), inputPath, mOptions.IncludeDirectories, options);
+}
+
+void CEffectCompiler::Save(CEffect& fx, const fs::path& outputPath) const
+{
+	switch (mOptions.Mode)
+	{
+	case eCompileMode::Compile:
+	{
+		fx.EnsureProgramsReflection();
+
+		CEffectSaver saver(fx);
+		saver.SaveTo(outputPath);
+		break;
+	}
+
+	case eCompileMode::Preprocess:
+	{
+		fx.EnsurePreprocessedSource();
+
+		std::ofstream outputStream(outputPath, std::ios::trunc);
+		outputStream << fx.PreprocessedSource();
+		break;
+	}
+
+	case eCompileMode::Validate:
+	{
+		fx.EnsureTechniques();
+		break;
+	}
+	}
+}
+
+// Escapes the characters that have a special meaning in Makefile rules, Ninja reads depfiles the same way
+static std::string EscapeDepfilePath(const fs::path& path)
+{
+	std::string escaped;
+	for (char c : path.generic_string())
+	{
+		switch (c)
+		{
+		case ' ':
+		case '#':
+			escaped += '\\';
+			break;
+		case '$':
+			escaped += '$';
+			break;
+		}
+		escaped += c;
+	}
+	return escaped;
+}
+
+// Reads the prerequisites of a depfile written by WriteDepfile, empty if the file can't be read
+static std::vector<fs::path> ReadDepfile(const fs::path& depfilePath)
+{
+	std::ifstream file(depfilePath);
+	if (!file)
+	{
+		return {};
+	}
+
+	std::stringstream contents;
+	contents << file.rdbuf();
+	const std::string str = contents.str();
+
+	std::vector<std::string> tokens(1);
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		const char c = str[i];
+		const char next = i + 1 < str.size() ? str[i + 1] : '\0';
+		if ((c == '\\' && (next == ' ' || next == '#')) || (c == '$' && next == '$'))
+		{
+			tokens.back() += next;
+			i++;
+		}
+		else if (c == '\\' && (next == '\n' || next == '\r'))
+		{
+			// line continuation
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+		{
+			if (!tokens.back().empty())
+			{
+				tokens.emplace_back();
+			}
+		}
+		else
+		{
+			tokens.back() += c;
+		}
+	}
+
+	if (tokens.back().empty())
+	{
+		tokens.pop_back();
+	}
+
+	// the first token is the target, followed by ':'
+	if (tokens.empty() || tokens[0].back() != ':')
+	{
+		return {};
+	}
+
+	return std::vector<fs::path>(tokens.begin() + 1, tokens.end());
+}
+
+void CEffectCompiler::WriteDepfile(CEffect& fx, const sCompileJob& job) const
+{
+	if (mOptions.Mode == eCompileMode::Compile && !mOptions.Techniques.empty())
+	{
+		// the output is missing the techniques filtered out, so a later build without the filter must not skip it
+		std::error_code ec;
+		fs::remove(GetDepfilePath(job.OutputPath), ec);
+		return;
+	}
+
+	if (!mOptions.WriteDepfile || mOptions.Mode == eCompileMode::Validate)
+	{
+		return;
+	}
+
+	fx.EnsurePreprocessedSource();
+
+	const fs::path depfilePath = GetDepfilePath(job.OutputPath);
+	std::ofstream depfile(depfilePath, std::ios::trunc);
+	depfile << EscapeDepfilePath(job.OutputPath) << ": " << EscapeDepfilePath(fs::absolute(job.InputPath));
+	for (const auto& f : fx.IncludedFiles())
+	{
+		depfile << " \\\n  " << EscapeDepfilePath(f);
+	}
+	depfile << "\n";
+
+	if (!depfile)
+	{
+		throw std::runtime_error("Failed to write depfile '" + depfilePath.string() + "'");
+	}
+}
+
+bool CEffectCompiler::IsUpToDate(const sCompileJob& job) const
+{
+	if (!mOptions.SkipUpToDate || mOptions.Mode == eCompileMode::Validate)
+	{
+		return false;
+	}
+
+	std::error_code ec;
+	const fs::file_time_type outputTime = fs::last_write_time(job.OutputPath, ec);
+	if (ec)
+	{
+		return false;
+	}
+
+	// without a depfile the included files are unknown, so it has to be compiled again
+	const std::vector<fs::path> dependencies = ReadDepfile(GetDepfilePath(job.OutputPath));
+	if (dependencies.empty())
+	{
+		return false;
+	}
+
+	for (const auto& d : dependencies)
+	{
+		const fs::file_time_type time = fs::last_write_time(d, ec);
+		if (ec || time > outputTime)
+		{
+			return false;
+		}
+	}
+
+	// the input may have been moved since the depfile was written
+	const fs::file_time_type inputTime = fs::last_write_time(job.InputPath, ec);
+	return !ec && inputTime <= outputTime;
+}
+
+fs::path CEffectCompiler::GetDepfilePath(const fs::path& outputPath)
+{
+	fs::path depfilePath = outputPath;
+	depfilePath += ".d";
+	return depfilePath;
+}
+
+sEffectDefine CEffectCompiler::ParseDefine(const std::string& define)
+{
+	const size_t separator = define.find('=');
+	sEffectDefine d;
+	d.Name = define.substr(0, separator);
+	d.Value = separator == std::string::npos ? "1" : define.substr(separator + 1);
+	if (d.Name.empty())
+	{
+		throw std::invalid_argument("Invalid define '" + define + "'");
+	}
+	return d;
+}
+
+// The define as part of a file name, with the characters that are not valid in file names replaced
+static std::string GetVariantNamePart(const std::string& define)
+{
+	std::string part = define;
+	for (char& c : part)
+	{
+		if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-')
+		{
+			c = '_';
+		}
+	}
+	return part;
+}
+
+std::vector<sEffectVariant> CEffectCompiler::ParsePermutations(const fs::path& file)
+{
+	std::ifstream input(file);
+	if (!input)
+	{
+		throw std::runtime_error("Failed to open permutations file '" + file.string() + "'");
+	}
+
+	std::vector<sEffectVariant> variants(1);
+	std::string line;
+	while (std::getline(input, line))
+	{
+		const size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#')
+		{
+			continue;
+		}
+
+		std::vector<sEffectVariant> alternatives;
+		for (size_t start = 0; start <= line.size();)
+		{
+			const size_t end = std::min(line.find('|', start), line.size());
+			sEffectVariant& alternative = alternatives.emplace_back();
+			std::istringstream defines(line.substr(start, end - start));
+			std::string define;
+			while (defines >> define)
+			{
+				alternative.Defines.push_back(ParseDefine(define));
+				alternative.Name += (alternative.Name.empty() ? "" : ".") + GetVariantNamePart(define);
+			}
+			start = end + 1;
+		}
+
+		if (variants.size() * alternatives.size() > MaxVariants)
+		{
+			throw std::invalid_argument("Permutations file '" + file.string() + "' has more than " + std::to_string(MaxVariants) + " variants");
+		}
+
+		std::vector<sEffectVariant> combined;
+		combined.reserve(variants.size() * alternatives.size());
+		for (const sEffectVariant& v : variants)
+		{
+			for (const sEffectVariant& a : alternatives)
+			{
+				sEffectVariant& c = combined.emplace_back(v);
+				c.Defines.insert(c.Defines.end(), a.Defines.begin(), a.Defines.end());
+				// the defines of axes with a single alternative are the same in every variant, so they don't name it
+				if (alternatives.size() > 1 && !a.Name.empty())
+				{
+					c.Name += (c.Name.empty() ? "" : ".") + a.Name;
+				}
+			}
+		}
+		variants = std::move(combined);
+	}
+
+	return variants;
+}
+
+std::vector<sCompileJob> CEffectCompiler::ExpandVariants(const std::vector<sCompileJob>& jobs, const std::vector<sEffectVariant>& variants)
+{
+	std::vector<sCompileJob> expanded;
+	expanded.reserve(jobs.size() * variants.size());
+	for (const sCompileJob& j : jobs)
+	{
+		for (const sEffectVariant& v : variants)
+		{
+			sCompileJob& e = expanded.emplace_back(j);
+			e.Defines.insert(e.Defines.end(), v.Defines.begin(), v.Defines.end());
+			if (!v.Name.empty())
+			{
+				fs::path fileName = j.OutputPath.stem();
+				fileName += "." + v.Name;
+				fileName += j.OutputPath.extension();
+				e.OutputPath.replace_filename(fileName);
+			}
+		}
+	}
+	return expanded;
+}
+
+fs::path CEffectCompiler::GetDefaultOutputPath(const fs::path& inputPath, eCompileMode mode, const fs::path& outputDirectory)
+{
+	fs::path outputPath = outputDirectory.empty() ? inputPath : outputDirectory / inputPath.filename();
+	if (mode == eCompileMode::Preprocess)
+	{
+		outputPath.replace_filename("preprocessed." + outputPath.filename().string());
+	}
+	else
+	{
+		outputPath.replace_extension("fxc");
+	}
+	return outputPath;
+}
+
+std::vector<fs::path> CEffectCompiler::FindBatchInputs(const fs::path& input)
+{
+	std::vector<fs::path> inputs;
+
+	const std::string fileName = input.filename().string();
+	if (fileName.find_first_of("*?") != std::string::npos)
+	{
+		const fs::path directory = fs::absolute(input).parent_path();
+		if (directory.string().find_first_of("*?") != std::string::npos)
+		{
+			throw std::invalid_argument("Wildcards are only supported in the file name of '" + input.string() + "'");
+		}
+
+		for (const auto& e : fs::directory_iterator(directory))
+		{
+			if (e.is_regular_file() && MatchesWildcard(fileName, e.path().filename().string()))
+			{
+				inputs.push_back(e.path());
+			}
+		}
+
+		// directory iteration order is unspecified, keep the results stable
+		std::sort(inputs.begin(), inputs.end());
+	}
+	else if (fs::is_directory(input))
+	{
+		for (const auto& e : fs::directory_iterator(fs::absolute(input)))
+		{
+			if (e.is_regular_file() && e.path().extension() == ".fx")
+			{
+				inputs.push_back(e.path());
+			}
+		}
+
+		std::sort(inputs.begin(), inputs.end());
+	}
+	else if (fs::is_regular_file(input) && input.extension() == ".fx")
+	{
+		// a single effect, not a manifest
+		inputs.push_back(fs::absolute(input));
+	}
+	else if (fs::is_regular_file(input))
+	{
+		// manifest file, one path per line, empty lines and lines starting with '#' are ignored
+		const fs::path manifestDir = fs::absolute(input).parent_path();
+		std::ifstream manifest(input);
+		std::string line;
+		while (std::getline(manifest, line))
+		{
+			const size_t begin = line.find_first_not_of(" \t\r");
+			if (begin == std::string::npos || line[begin] == '#')
+			{
+				continue;
+			}
+
+			const size_t end = line.find_last_not_of(" \t\r");
+			inputs.push_back(fs::absolute(manifestDir / line.substr(begin, end - begin + 1)));
+		}
+	}
+	else
+	{
+		throw std::runtime_error("Path '" + input.string() + "' does not exist");
+	}
+
+	return inputs;
+}
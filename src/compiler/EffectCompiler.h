@@ -0,0 +1,101 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CodeInterner.h"
+#include "Effect.h"
+#include "IncludeCache.h"
+
+class CCodeCache;
+
+enum class eCompileMode
+{
+	Compile = 0,	// compiles the effect and saves the .fxc file
+	Preprocess,		// saves the preprocessed source
+	Validate,		// only parses the effect, nothing is saved
+};
+
+struct sCompilerOptions
+{
+	eCompileMode Mode = eCompileMode::Compile;
+	std::vector<std::filesystem::path> IncludeDirectories;
+	std::vector<sEffectDefine> Defines;
+	std::vector<std::string> Techniques;	// see sEffectOptions::Techniques
+	uint32_t NumJobs = 1;
+	CCodeCache* Cache = nullptr;
+	bool WriteDepfile = false;	// writes the files each output depends on next to it, see GetDepfilePath
+	bool SkipUpToDate = false;	// skips effects whose output is newer than every file listed in its depfile
+	bool MapIncludeFiles = true;	// see CIncludeCache
+	bool RecordDuplicatePrograms = false;	// see CCodeInterner::WriteDuplicatesReport
+};
+
+struct sCompileJob
+{
+	std::filesystem::path InputPath;
+	std::filesystem::path OutputPath;
+	std::vector<sEffectDefine> Defines;	// defined after the defines in the options, e.g. the defines of a variant
+};
+
+// One combination of defines of a define matrix, see CEffectCompiler::ParsePermutations
+struct sEffectVariant
+{
+	std::string Name;	// added to the output file names, empty if it has no defines that change between variants
+	std::vector<sEffectDefine> Defines;
+};
+
+// Compiles effect files from disk, sharing the include files between all the effects it compiles
+class CEffectCompiler
+{
+private:
+	sCompilerOptions mOptions;
+	CIncludeCache mIncludeCache;
+	CCodeInterner mCodeInterner;
+
+public:
+	CEffectCompiler(const sCompilerOptions& options);
+
+	// Compiles a single effect, throws on errors. Returns false if it was skipped because it is up to date.
+	bool Compile(const sCompileJob& job, uint32_t numJobs);
+	// Compiles all the effects, scheduled across the number of jobs in the options. Errors are
+	// written to `log` and don't stop the remaining effects. Returns the number of effects that failed.
+	// Effects whose source preprocesses to the same text as another effect in the batch, e.g. variants
+	// that only differ in unused defines, copy its output instead of being compiled again.
+	size_t CompileBatch(const std::vector<sCompileJob>& jobs, std::ostream& log);
+	// Compiles all the effects and then compiles again the effects whose input or included files
+	// change, until the process is terminated. The include cache is updated with the changed files.
+	[[noreturn]] void Watch(const std::vector<sCompileJob>& jobs, std::ostream& log);
+
+	inline const sCompilerOptions& Options() const { return mOptions; }
+	inline const CIncludeCache& IncludeCache() const { return mIncludeCache; }
+	inline const CCodeInterner& CodeInterner() const { return mCodeInterner; }
+
+	// outputDirectory: if empty, the output file is placed next to the input file
+	static std::filesystem::path GetDefaultOutputPath(const std::filesystem::path& inputPath, eCompileMode mode, const std::filesystem::path& outputDirectory = {});
+	// input: a directory (every .fx file in it), a glob pattern in the file name (e.g. 'effects/*.fx'),
+	// a single .fx file or a manifest file with one path per line, relative to the manifest
+	static std::vector<std::filesystem::path> FindBatchInputs(const std::filesystem::path& input);
+	static std::filesystem::path GetDepfilePath(const std::filesystem::path& outputPath);
+	// define: `NAME` or `NAME=VALUE`
+	static sEffectDefine ParseDefine(const std::string& define);
+	// Reads a define matrix, one axis per line. An axis lists its alternatives separated by '|', each one
+	// with zero or more defines separated by spaces, and the variants are every combination of one
+	// alternative of each axis. Empty lines and lines starting with '#' are ignored.
+	static std::vector<sEffectVariant> ParsePermutations(const std::filesystem::path& file);
+	// Returns a job for each variant of each job, the output file names have the variant name before the extension
+	static std::vector<sCompileJob> ExpandVariants(const std::vector<sCompileJob>& jobs, const std::vector<sEffectVariant>& variants);
+
+private:
+	struct sSharedOutputs;
+
+	// Errors are returned in `message` instead of thrown. outDependencies: if not null, receives the
+	// input file and the files it included, even if it failed to compile.
+	bool CompileBatchJob(const sCompileJob& job, uint32_t numJobs, sSharedOutputs& sharedOutputs, std::string& message, std::vector<std::filesystem::path>* outDependencies);
+	// Compiles jobs[indices[i]] in parallel
+	size_t CompileBatchJobs(const std::vector<sCompileJob>& jobs, const std::vector<size_t>& indices, std::ostream& log, std::vector<std::vector<std::filesystem::path>>* outDependencies);
+	std::unique_ptr<CEffect> LoadEffect(const sCompileJob& job, uint32_t numJobs);
+	void Save(CEffect& fx, const std::filesystem::path& outputPath) const;
+	void WriteDepfile(CEffect& fx, const sCompileJob& job) const;
+	bool IsUpToDate(const sCompileJob& job) const;
+};
@@ -1,11 +1,12 @@
 #include "EffectInclude.h"
 #include <stdexcept>
-#include <fstream>
 
 namespace fs = std::filesystem;
 
-CEffectInclude::CEffectInclude(const fs::path& localRootDirectory, const std::vector<fs::path>& includeDirs)
-	: mLocalRootDirectory(fs::absolute(localRootDirectory))
+CEffectInclude::CEffectInclude(const fs::path& localRootDirectory, const std::vector<fs::path>& includeDirs, CIncludeCache* cache)
+	: mLocalRootDirectory(fs::absolute(localRootDirectory)),
+	mOwnedCache(cache ? nullptr : std::make_unique<CIncludeCache>()),
+	mCache(cache ? cache : mOwnedCache.get())
 {
 	if (!fs::is_directory(mLocalRootDirectory))
 	{
@@ -22,7 +23,6 @@ CEffectInclude::CEffectInclude(const fs::path& localRootDirectory, const std::ve
 HRESULT CEffectInclude::Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes)
 {
 	fs::path filePath;
-	bool foundFile = false;
 
 	switch (IncludeType)
 	{
@@ -31,10 +31,9 @@ HRESULT CEffectInclude::Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPC
 		// search for the file in the include directories
 		for (const auto& includeDir : mIncludeDirectories)
 		{
-			filePath = fs::weakly_canonical(includeDir / pFileName);
-			if (fs::is_regular_file(filePath))
+			filePath = mCache->Resolve(includeDir, pFileName);
+			if (!filePath.empty())
 			{
-				foundFile = true;
 				break;
 			}
 		}
@@ -45,25 +44,34 @@ HRESULT CEffectInclude::Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPC
 	case D3D_INCLUDE_LOCAL:
 	{
 		// get the file relative to the parent file
-		const fs::path& rootDir = pParentData ? 
-			mFileBuffers.at(reinterpret_cast<uintptr_t>(pParentData)).Path.parent_path() :
-			mLocalRootDirectory;
+		fs::path rootDir = mLocalRootDirectory;
+		if (pParentData)
+		{
+			std::lock_guard<std::mutex> lock(mOpenFilesMutex);
+			auto parent = mOpenFiles.find(reinterpret_cast<uintptr_t>(pParentData));
+			if (parent == mOpenFiles.end())
+			{
+				break;
+			}
 
-		filePath = fs::weakly_canonical(rootDir / pFileName);
-		foundFile = true;
+			rootDir = parent->second.File->Path.parent_path();
+		}
+
+		filePath = mCache->Resolve(rootDir, pFileName);
 
 		break;
 	}
 	}
 
-	if (foundFile && fs::is_regular_file(filePath))
+	if (!filePath.empty())
 	{
-		const sFileBuffer& f = OpenFile(filePath);
-
-		*ppData = f.Buffer.data();
-		*pBytes = static_cast<UINT>(f.Buffer.size());
+		if (const sIncludeFile* f = OpenFile(filePath))
+		{
+			*ppData = f->Data;
+			*pBytes = static_cast<UINT>(f->Size);
 
-		return S_OK;
+			return S_OK;
+		}
 	}
 
 	*ppData = nullptr;
@@ -75,33 +83,35 @@ HRESULT CEffectInclude::Close(LPCVOID pData)
 {
 	return CloseFile(reinterpret_cast<uintptr_t>(pData)) ? S_OK : E_FAIL;
 }
-const CEffectInclude::sFileBuffer& CEffectInclude::OpenFile(const std::filesystem::path& filePath)
-{			
-	// open file
-	std::ifstream file(filePath, std::ios::binary | std::ios::in | std::ios::ate); // open at the end to get the size with tellg()
-	std::streamsize fileSize = file.tellg();
-	file.seekg(0, std::ios::beg);
-
-	// read file into buffer
-	sFileBuffer f;
-	f.Buffer.resize(fileSize);
-	file.read(f.Buffer.data(), fileSize);
-
-	// save the path for this file in case it includes more files relative to it
-	f.Path = filePath;
-
-	const uintptr_t key = reinterpret_cast<uintptr_t>(f.Buffer.data());
-	auto at = mFileBuffers.try_emplace(key, std::move(f)).first;
-	return at->second;
+const sIncludeFile* CEffectInclude::OpenFile(const std::filesystem::path& filePath)
+{
+	std::shared_ptr<const sIncludeFile> f = mCache->Open(filePath);
+	if (!f)
+	{
+		return nullptr;
+	}
+
+	// the data pointer identifies the file in Close and when it is the parent of another include
+	const uintptr_t key = reinterpret_cast<uintptr_t>(f->Data);
+	std::lock_guard<std::mutex> lock(mOpenFilesMutex);
+	mIncludedFiles.insert(f->Path);
+	sOpenFile& openFile = mOpenFiles[key];
+	openFile.File = std::move(f);
+	openFile.RefCount++;
+	return openFile.File.get();
 }
 
 bool CEffectInclude::CloseFile(uintptr_t key)
 {
-	// search for the buffer with the same data pointer and delete it
-	auto toDelete = mFileBuffers.find(key);
-	if (toDelete != mFileBuffers.cend())
+	// search for the file with the same data pointer and release it
+	std::lock_guard<std::mutex> lock(mOpenFilesMutex);
+	auto toClose = mOpenFiles.find(key);
+	if (toClose != mOpenFiles.cend())
 	{
-		mFileBuffers.erase(toDelete);
+		if (--toClose->second.RefCount == 0)
+		{
+			mOpenFiles.erase(toClose);
+		}
 		return true;
 	}
 	else
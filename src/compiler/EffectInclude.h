@@ -2,39 +2,43 @@
 #include <d3dcommon.h>
 #include <unordered_map>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include "IncludeCache.h"
 
 class CEffectInclude : public ID3DInclude
 {
 private:
-	struct sFileBuffer
+	struct sOpenFile
 	{
-		std::vector<char> Buffer;
-		std::filesystem::path Path;
-
-		sFileBuffer() = default;
-		sFileBuffer(sFileBuffer&&) = default;
-		sFileBuffer& operator=(sFileBuffer&&) = default;
-		sFileBuffer(const sFileBuffer&) = delete;
-		sFileBuffer& operator=(const sFileBuffer&) = delete;
-		
+		std::shared_ptr<const sIncludeFile> File;
+		uint32_t RefCount = 0; // the same file can be opened again before it is closed
 	};
 
 	std::filesystem::path mLocalRootDirectory;
 	std::vector<std::filesystem::path> mIncludeDirectories;
-	std::unordered_map<uintptr_t, sFileBuffer> mFileBuffers;
+	std::unique_ptr<CIncludeCache> mOwnedCache;
+	CIncludeCache* mCache;
+	std::unordered_map<uintptr_t, sOpenFile> mOpenFiles;
+	std::mutex mOpenFilesMutex; // Open/Close may be called from multiple threads when compiling in parallel
+	std::set<std::filesystem::path> mIncludedFiles; // guarded by mOpenFilesMutex
 
 public:
-	CEffectInclude(const std::filesystem::path& localRootDirectory, const std::vector<std::filesystem::path>& includeDirs);
+	// cache: shared cache of the include files contents, if null the files are cached only for this instance
+	CEffectInclude(const std::filesystem::path& localRootDirectory, const std::vector<std::filesystem::path>& includeDirs, CIncludeCache* cache = nullptr);
 	CEffectInclude(const CEffectInclude&) = delete;
 	CEffectInclude& operator=(const CEffectInclude&) = delete;
 
 	inline const std::filesystem::path& LocalRootDirectory() const { return mLocalRootDirectory; }
 	inline const std::vector<std::filesystem::path>& IncludeDirectories() const { return mIncludeDirectories; }
+	// Every file opened successfully so far, must not be called while files are being opened
+	inline const std::set<std::filesystem::path>& IncludedFiles() const { return mIncludedFiles; }
 
 	STDMETHOD(Open)(THIS_ D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID* ppData, UINT* pBytes) override;
 	STDMETHOD(Close)(THIS_ LPCVOID pData) override;
 
 private:
-	const sFileBuffer& OpenFile(const std::filesystem::path& filePath);
+	const sIncludeFile* OpenFile(const std::filesystem::path& filePath);
 	bool CloseFile(uintptr_t key);
 };
@@ -0,0 +1,247 @@
+#include "EffectLoader.h"
+#include <stdexcept>
+#include <string>
+#include "MappedFile.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr uint32_t Header = ('r' << 0) | ('g' << 8) | ('x' << 16) | ('e' << 24);
+	constexpr size_t GeometryProgramType = 4;
+
+	// Bounds checked reader over the file data
+	class CReader
+	{
+	private:
+		const uint8_t* mData;
+		size_t mSize;
+		size_t mPosition;
+
+	public:
+		CReader(const uint8_t* data, size_t size)
+			: mData(data), mSize(size), mPosition(0)
+		{
+		}
+
+		inline size_t Position() const { return mPosition; }
+		inline size_t Remaining() const { return mSize - mPosition; }
+
+		const uint8_t* Read(size_t size)
+		{
+			if (size > Remaining())
+			{
+				Fail("unexpected end of file");
+			}
+
+			const uint8_t* p = mData + mPosition;
+			mPosition += size;
+			return p;
+		}
+
+		template<typename T>
+		T Read()
+		{
+			T v;
+			memcpy(&v, Read(sizeof(T)), sizeof(T));
+			return v;
+		}
+
+		inline uint8_t ReadUInt8() { return Read<uint8_t>(); }
+		inline uint16_t ReadUInt16() { return Read<uint16_t>(); }
+		inline uint32_t ReadUInt32() { return Read<uint32_t>(); }
+
+		// returns the string without the null terminator
+		std::string_view ReadLengthPrefixedString()
+		{
+			const uint8_t length = ReadUInt8();
+			if (length == 0)
+			{
+				return {};
+			}
+
+			const char* str = reinterpret_cast<const char*>(Read(length));
+			if (str[length - 1] != '\0')
+			{
+				Fail("string is not null terminated");
+			}
+			return { str, static_cast<size_t>(length - 1) };
+		}
+
+		template<typename T>
+		CUnalignedView<T> ReadArray(size_t count)
+		{
+			return { Read(count * sizeof(T)), count };
+		}
+
+		[[noreturn]] void Fail(const char* reason) const
+		{
+			throw std::runtime_error("Invalid .fxc file at offset " + std::to_string(mPosition) + ": " + reason);
+		}
+	};
+
+	void ReadAnnotations(CReader& r, std::vector<sLoadedAnnotation>& outAnnotations)
+	{
+		const uint8_t count = r.ReadUInt8();
+		outAnnotations.resize(count);
+		for (auto& a : outAnnotations)
+		{
+			a.Name = r.ReadLengthPrefixedString();
+			a.Type = r.ReadUInt8();
+			switch (a.Type)
+			{
+			case 0:
+			case 1:
+				a.Value = r.ReadUInt32();
+				break;
+			case 2:
+				a.Value = 0;
+				a.StringValue = r.ReadLengthPrefixedString();
+				break;
+			default:
+				r.Fail("unknown annotation type");
+			}
+		}
+	}
+
+	void ReadPrograms(CReader& r, std::vector<sLoadedProgram>& outPrograms, size_t type)
+	{
+		const uint8_t count = r.ReadUInt8();
+		outPrograms.resize(count);
+		for (auto& p : outPrograms)
+		{
+			p.Name = r.ReadLengthPrefixedString();
+
+			p.Variables.resize(r.ReadUInt8());
+			for (auto& v : p.Variables)
+			{
+				v = r.ReadLengthPrefixedString();
+			}
+
+			p.Buffers.resize(r.ReadUInt8());
+			for (auto& b : p.Buffers)
+			{
+				b.Name = r.ReadLengthPrefixedString();
+				b.Register = r.ReadUInt8();
+				b.Unknown = r.ReadUInt8();
+			}
+
+			if (type == GeometryProgramType && r.ReadUInt8() != 0)
+			{
+				r.Fail("geometry program data is not supported");
+			}
+
+			const uint32_t codeSize = r.ReadUInt32();
+			p.Code = { reinterpret_cast<const char*>(r.Read(codeSize)), codeSize };
+			p.TargetMajor = 0;
+			p.TargetMinor = 0;
+			if (codeSize > 0)
+			{
+				p.TargetMajor = r.ReadUInt8();
+				p.TargetMinor = r.ReadUInt8();
+			}
+		}
+	}
+
+	void ReadBuffers(CReader& r, std::vector<sLoadedBuffer>& outBuffers, std::vector<sLoadedVariable>& outVariables)
+	{
+		outBuffers.resize(r.ReadUInt8());
+		for (auto& b : outBuffers)
+		{
+			b.Size = r.ReadUInt32();
+			for (uint16_t& reg : b.Registers)
+			{
+				reg = r.ReadUInt16();
+			}
+			b.Name = r.ReadLengthPrefixedString();
+		}
+
+		outVariables.resize(r.ReadUInt8());
+		for (auto& v : outVariables)
+		{
+			v.Type = r.ReadUInt8();
+			v.Count = r.ReadUInt8();
+			v.Flags1 = r.ReadUInt8();
+			v.Flags2 = r.ReadUInt8();
+			v.Name = r.ReadLengthPrefixedString();
+			v.Description = r.ReadLengthPrefixedString();
+			v.Offset = r.ReadUInt32();
+			v.BufferNameHash = r.ReadUInt32();
+			ReadAnnotations(r, v.Annotations);
+			v.InitialValues = r.ReadArray<uint32_t>(r.ReadUInt8());
+		}
+	}
+
+	void ReadTechniques(CReader& r, std::vector<sLoadedTechnique>& outTechniques)
+	{
+		outTechniques.resize(r.ReadUInt8());
+		for (auto& t : outTechniques)
+		{
+			t.Name = r.ReadLengthPrefixedString();
+			t.Passes.resize(r.ReadUInt8());
+			for (auto& p : t.Passes)
+			{
+				for (uint8_t& idx : p.Programs)
+				{
+					idx = r.ReadUInt8();
+				}
+				p.Assignments = r.ReadArray<sLoadedAssignment>(r.ReadUInt8());
+			}
+		}
+	}
+}
+
+CEffectLoader::CEffectLoader(const fs::path& filePath)
+	: mFile(std::make_unique<CMappedFile>(filePath))
+{
+	mData = mFile->Data();
+	mSize = mFile->Size();
+	Load();
+}
+
+CEffectLoader::CEffectLoader(const uint8_t* data, size_t size)
+	: mData(data), mSize(size)
+{
+	Load();
+}
+
+CEffectLoader::~CEffectLoader() = default;
+
+void CEffectLoader::Load()
+{
+	CReader r(mData, mSize);
+
+	if (r.ReadUInt32() != Header)
+	{
+		r.Fail("unknown header");
+	}
+
+	mVertexType = r.ReadUInt32();
+	ReadAnnotations(r, mAnnotations);
+	for (size_t i = 0; i < FxcNumberOfProgramTypes; i++)
+	{
+		ReadPrograms(r, mPrograms[i], i);
+	}
+	ReadBuffers(r, mGlobalBuffers, mGlobalVariables);
+	ReadBuffers(r, mLocalBuffers, mLocalVariables);
+	ReadTechniques(r, mTechniques);
+
+	if (r.Remaining() != 0)
+	{
+		r.Fail("unexpected data after the techniques");
+	}
+
+	for (const auto& t : mTechniques)
+	{
+		for (const auto& p : t.Passes)
+		{
+			for (size_t i = 0; i < FxcNumberOfProgramTypes; i++)
+			{
+				if (p.Programs[i] >= mPrograms[i].size())
+				{
+					throw std::runtime_error("Invalid .fxc file: technique '" + std::string(t.Name) + "' references an unknown program");
+				}
+			}
+		}
+	}
+}
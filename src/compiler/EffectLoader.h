@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+class CMappedFile;
+
+// Non-owning view of an array stored in the .fxc file. The values are not aligned in the file,
+// so they are copied out one at a time.
+template<typename T>
+class CUnalignedView
+{
+	static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+private:
+	const uint8_t* mData;
+	size_t mSize;
+
+public:
+	CUnalignedView()
+		: mData(nullptr), mSize(0)
+	{
+	}
+
+	CUnalignedView(const uint8_t* data, size_t size)
+		: mData(data), mSize(size)
+	{
+	}
+
+	inline size_t size() const { return mSize; }
+	inline bool empty() const { return mSize == 0; }
+
+	inline T operator[](size_t index) const
+	{
+		T v;
+		memcpy(&v, mData + index * sizeof(T), sizeof(T));
+		return v;
+	}
+};
+
+// Same order as eProgramType
+constexpr size_t FxcNumberOfProgramTypes = 6;
+
+struct sLoadedAnnotation
+{
+	std::string_view Name;
+	uint8_t Type;					// 0 = int, 1 = float, 2 = string
+	uint32_t Value;					// raw bits of the int or float value
+	std::string_view StringValue;
+};
+
+struct sLoadedProgramBuffer
+{
+	std::string_view Name;
+	uint8_t Register;
+	uint8_t Unknown;
+};
+
+struct sLoadedProgram
+{
+	std::string_view Name;
+	std::vector<std::string_view> Variables;
+	std::vector<sLoadedProgramBuffer> Buffers;
+	std::string_view Code;			// empty for the NULL program
+	uint8_t TargetMajor;
+	uint8_t TargetMinor;
+};
+
+struct sLoadedBuffer
+{
+	uint32_t Size;
+	uint16_t Registers[FxcNumberOfProgramTypes];
+	std::string_view Name;
+};
+
+struct sLoadedVariable
+{
+	uint8_t Type;
+	uint8_t Count;
+	uint8_t Flags1;
+	uint8_t Flags2;
+	std::string_view Name;
+	std::string_view Description;
+	uint32_t Offset;
+	uint32_t BufferNameHash;
+	std::vector<sLoadedAnnotation> Annotations;
+	CUnalignedView<uint32_t> InitialValues;
+};
+
+struct sLoadedAssignment
+{
+	uint32_t Type;
+	uint32_t Value;
+};
+
+struct sLoadedPass
+{
+	uint8_t Programs[FxcNumberOfProgramTypes]; // indices in CEffectLoader::Programs, 0 is the NULL program
+	CUnalignedView<sLoadedAssignment> Assignments;
+};
+
+struct sLoadedTechnique
+{
+	std::string_view Name;
+	std::vector<sLoadedPass> Passes;
+};
+
+// Reads .fxc files. Strings, bytecode and value arrays point directly into the file data, nothing
+// is copied out of it. Throws std::runtime_error if the file is malformed.
+class CEffectLoader
+{
+private:
+	std::unique_ptr<CMappedFile> mFile;
+	const uint8_t* mData;
+	size_t mSize;
+
+	uint32_t mVertexType;
+	std::vector<sLoadedAnnotation> mAnnotations;
+	std::vector<sLoadedProgram> mPrograms[FxcNumberOfProgramTypes];
+	std::vector<sLoadedBuffer> mGlobalBuffers;
+	std::vector<sLoadedVariable> mGlobalVariables;
+	std::vector<sLoadedBuffer> mLocalBuffers;
+	std::vector<sLoadedVariable> mLocalVariables;
+	std::vector<sLoadedTechnique> mTechniques;
+
+public:
+	// Maps the file in memory for the lifetime of the loader
+	CEffectLoader(const std::filesystem::path& filePath);
+	// Does not copy `data`, it must outlive the loader
+	CEffectLoader(const uint8_t* data, size_t size);
+	~CEffectLoader();
+	CEffectLoader(const CEffectLoader&) = delete;
+	CEffectLoader& operator=(const CEffectLoader&) = delete;
+
+	inline const uint8_t* Data() const { return mData; }
+	inline size_t Size() const { return mSize; }
+
+	inline uint32_t VertexType() const { return mVertexType; }
+	inline const std::vector<sLoadedAnnotation>& Annotations() const { return mAnnotations; }
+	// type: eProgramType value
+	inline const std::vector<sLoadedProgram>& Programs(size_t type) const { return mPrograms[type]; }
+	inline const std::vector<sLoadedBuffer>& GlobalBuffers() const { return mGlobalBuffers; }
+	inline const std::vector<sLoadedVariable>& GlobalVariables() const { return mGlobalVariables; }
+	inline const std::vector<sLoadedBuffer>& LocalBuffers() const { return mLocalBuffers; }
+	inline const std::vector<sLoadedVariable>& LocalVariables() const { return mLocalVariables; }
+	inline const std::vector<sLoadedTechnique>& Techniques() const { return mTechniques; }
+
+private:
+	void Load();
+};
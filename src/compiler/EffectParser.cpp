@@ -1,77 +1,242 @@
 #include "EffectParser.h"
 #include "HlslGrammar.h"
-
-// TODO: combine the various grammars in one and do a single pegtl::parse
+#include "Parallel.h"
+#include <ctype.h>
+#include <algorithm>
+#include <limits>
+#include <iterator>
 
 CEffectParser::CEffectParser(std::string_view source)
 	: mSource(source)
 {
 }
 
-std::vector<sTechnique> CEffectParser::GetTechniques() const
+sParsedEffect CEffectParser::Parse(uint32_t numJobs) const
 {
-	hlsl_grammar::technique_state s;
-	pegtl::string_input<> in(mSource, "CEffectParser");
-	try
-	{
-		pegtl::parse<hlsl_grammar::technique_grammar, hlsl_grammar::technique_action>(in, s);
+	const size_t maxChunks = std::min<size_t>(numJobs, mSource.size() / MinChunkSize);
+	const std::vector<sChunk> chunks = FindChunks(maxChunks);
 
-		return s.Techniques;
+	std::vector<sParsedEffect> results(chunks.size());
+	if (chunks.size() == 1)
+	{
+		results[0] = ParseChunk(mSource, chunks[0]);
 	}
-	catch (const pegtl::parse_error& e)
+	else
 	{
-		auto& p = e.positions.front();
+		ParallelFor(chunks.size(), numJobs, [this, &chunks, &results](size_t i)
+		{
+			const size_t end = i + 1 < chunks.size() ? chunks[i + 1].Offset : mSource.size();
+			results[i] = ParseChunk(mSource.substr(chunks[i].Offset, end - chunks[i].Offset), chunks[i]);
+		});
+	}
 
-		throw std::runtime_error(
-			"Technique parser error:\n" +
-			std::string(e.what()) + "\n" +
-			in.line_at(p) + "\n" +
-			std::string(p.byte_in_line, ' ') + "^\n"
-		);
+	sParsedEffect result;
+	SortPrograms(results, result);
+
+	// merge in source order
+	for (sParsedEffect& r : results)
+	{
+		std::move(r.Techniques.begin(), r.Techniques.end(), std::back_inserter(result.Techniques));
+		std::move(r.SamplerStates.begin(), r.SamplerStates.end(), std::back_inserter(result.SamplerStates));
+		std::move(r.SharedVariables.begin(), r.SharedVariables.end(), std::back_inserter(result.SharedVariables));
 	}
+	return result;
 }
 
-std::vector<sSamplerState> CEffectParser::GetSamplerStates() const
+void CEffectParser::SortPrograms(std::vector<sParsedEffect>& chunks, sParsedEffect& result)
 {
-	hlsl_grammar::sampler_state s;
-	pegtl::string_input<> in(mSource, "CEffectParser");
-	try
+	constexpr size_t NumTypes = static_cast<size_t>(eProgramType::NumberOfTypes);
+
+	for (size_t type = 0; type < NumTypes; type++)
 	{
-		pegtl::parse<hlsl_grammar::sampler_grammar, hlsl_grammar::sampler_action>(in, s);
+		std::vector<std::string_view>& programs = result.Programs[type];
+		for (const sParsedEffect& c : chunks)
+		{
+			programs.insert(programs.end(), c.Programs[type].begin(), c.Programs[type].end());
+		}
+		std::sort(programs.begin(), programs.end());
+		programs.erase(std::unique(programs.begin(), programs.end()), programs.end());
 
-		return s.Samplers;
+		if (programs.size() > std::numeric_limits<uint16_t>::max())
+		{
+			throw std::length_error("Number of programs exceeds " + std::to_string(std::numeric_limits<uint16_t>::max()));
+		}
 	}
-	catch (const pegtl::parse_error& e)
+
+	std::vector<uint16_t> newIds[NumTypes];
+	for (sParsedEffect& c : chunks)
 	{
-		auto& p = e.positions.front();
+		for (size_t type = 0; type < NumTypes; type++)
+		{
+			const std::vector<std::string_view>& programs = result.Programs[type];
 
-		throw std::runtime_error(
-			"Sampler state parser error:\n" +
-			std::string(e.what()) + "\n" +
-			in.line_at(p) + "\n" +
-			std::string(p.byte_in_line, ' ') + "^\n"
-		);
+			newIds[type].assign(1, 0); // NULL program
+			for (std::string_view name : c.Programs[type])
+			{
+				const auto e = std::lower_bound(programs.begin(), programs.end(), name);
+				newIds[type].push_back(static_cast<uint16_t>(std::distance(programs.begin(), e) + 1));
+			}
+		}
+
+		for (sTechnique& t : c.Techniques)
+		{
+			for (sTechniquePass& p : t.Passes)
+			{
+				for (size_t type = 0; type < NumTypes; type++)
+				{
+					p.Programs[type] = newIds[type][p.Programs[type]];
+				}
+			}
+		}
+	}
+}
+
+std::vector<CEffectParser::sChunk> CEffectParser::FindChunks(size_t maxChunks) const
+{
+	std::vector<sChunk> chunks;
+	chunks.push_back({ 0, 1 });
+	if (maxChunks <= 1)
+	{
+		return chunks;
+	}
+
+	enum class eState { Code, LineComment, BlockComment, String, Directive };
+
+	const size_t size = mSource.size();
+	const size_t chunkSize = size / maxChunks;
+	size_t nextSplit = chunkSize;
+	eState state = eState::Code;
+	size_t depth = 0;
+	char last = 0;				// last character outside whitespace, comments and directives
+	bool onlySpaceInLine = true;
+	size_t line = 1;
+	for (size_t i = 0; i < size && chunks.size() < maxChunks; i++)
+	{
+		const char c = mSource[i];
+		const char next = i + 1 < size ? mSource[i + 1] : '\0';
+
+		// split before the line that starts here if the previous declaration is complete. A sampler state
+		// may continue with a ';' after its '}', so the next line must not start with one.
+		if (i >= nextSplit && state == eState::Code && depth == 0 && mSource[i - 1] == '\n' && (last == ';' || last == '}'))
+		{
+			const size_t nonSpace = mSource.find_first_not_of(" \t\r\n\v\f", i);
+			if (nonSpace == std::string_view::npos || mSource[nonSpace] != ';')
+			{
+				chunks.push_back({ i, line });
+				nextSplit = i + chunkSize;
+			}
+		}
+
+		switch (state)
+		{
+		case eState::Code:
+			if (c == '/' && next == '/')
+			{
+				state = eState::LineComment;
+			}
+			else if (c == '/' && next == '*')
+			{
+				state = eState::BlockComment;
+				i++; // so '/*/' doesn't end the comment
+			}
+			else if (c == '"')
+			{
+				state = eState::String;
+				last = c;
+			}
+			else if (c == '#' && onlySpaceInLine)
+			{
+				state = eState::Directive;
+			}
+			else if (c == '{')
+			{
+				depth++;
+				last = c;
+			}
+			else if (c == '}')
+			{
+				depth -= depth > 0 ? 1 : 0;
+				last = c;
+			}
+			else if (!isspace(static_cast<unsigned char>(c)))
+			{
+				last = c;
+			}
+			break;
+
+		case eState::LineComment:
+		case eState::Directive:
+			if (c == '\n')
+			{
+				state = eState::Code;
+			}
+			break;
+
+		case eState::BlockComment:
+			if (c == '*' && next == '/')
+			{
+				state = eState::Code;
+				i++;
+			}
+			break;
+
+		case eState::String:
+			if (c == '\\' && next != '\n')
+			{
+				i++;
+			}
+			else if (c == '"' || c == '\n')
+			{
+				state = eState::Code;
+			}
+			break;
+		}
+
+		// the characters skipped above are never new lines
+		if (c == '\n')
+		{
+			line++;
+			onlySpaceInLine = true;
+		}
+		else if (!isspace(static_cast<unsigned char>(c)))
+		{
+			onlySpaceInLine = false;
+		}
 	}
+
+	return chunks;
 }
 
-std::vector<std::string> CEffectParser::GetSharedVariablesNames() const
+sParsedEffect CEffectParser::ParseChunk(std::string_view chunk, const sChunk& start) const
 {
-	hlsl_grammar::shared_variable_state s;
-	pegtl::string_input<> in(mSource, "CEffectParser");
+	CEffectScanner scanner(chunk);
+	hlsl_grammar::effect_state s;
+	s.Scanner = &scanner;
+	// the chunks start at the beginning of a line, so the positions are the same as when parsing the source whole
+	pegtl::memory_input<> in(chunk.data(), chunk.data() + chunk.size(), "CEffectParser", start.Offset, start.Line, 0);
 	try
 	{
-		pegtl::parse<hlsl_grammar::shared_variable_grammar, hlsl_grammar::shared_variable_action>(in, s);
+		pegtl::parse<hlsl_grammar::effect_grammar, hlsl_grammar::effect_action>(in, s);
 
-		return s.Names;
+		sParsedEffect result;
+		result.Techniques = std::move(s.Techniques);
+		std::move(std::begin(s.Programs), std::end(s.Programs), std::begin(result.Programs));
+		result.SamplerStates = std::move(s.Samplers);
+		result.SharedVariables = std::move(s.SharedVariables);
+		return result;
 	}
 	catch (const pegtl::parse_error& e)
 	{
 		auto& p = e.positions.front();
 
+		// the position is relative to the start of the source, not of the chunk the input starts at
+		const size_t lineBegin = p.byte - p.byte_in_line;
+		const size_t lineEnd = std::min(mSource.find_first_of("\r\n", p.byte), mSource.size());
+
 		throw std::runtime_error(
-			"Shared variables parser error:\n" +
+			"Effect parser error:\n" +
 			std::string(e.what()) + "\n" +
-			in.line_at(p) + "\n" +
+			std::string(mSource.substr(lineBegin, lineEnd - lineBegin)) + "\n" +
 			std::string(p.byte_in_line, ' ') + "^\n"
 		);
 	}
@@ -2,17 +2,43 @@
 #include <string_view>
 #include "Effect.h"
 
+struct sParsedEffect
+{
+	std::vector<sTechnique> Techniques;
+	std::vector<std::string_view> Programs[static_cast<size_t>(eProgramType::NumberOfTypes)]; // see CEffect::Programs
+	std::vector<sSamplerState> SamplerStates;
+	std::vector<std::string_view> SharedVariables;
+};
+
 class CEffectParser
 {
 private:
 	std::string_view mSource;
 
 public:
-	// source: HLSL source code already preprocessed
+	// Sources smaller than this are not split, parsing them in parallel doesn't pay off
+	static constexpr size_t MinChunkSize = 256 * 1024;
+
+	// source: HLSL source code already preprocessed, the parsed names are views of it
 	CEffectParser(std::string_view source);
 
-	std::vector<sTechnique> GetTechniques() const;
-	std::vector<sSamplerState> GetSamplerStates() const;
-	std::vector<std::string> GetSharedVariablesNames() const;
-};
+	// Parses the techniques, sampler states and shared variables in a single pass. Large sources are split
+	// in chunks parsed in parallel by up to `numJobs` threads, the results are the same as parsing it whole.
+	sParsedEffect Parse(uint32_t numJobs = 1) const;
+
+private:
+	// where the chunk starts in the source, also used for the positions of the error messages
+	struct sChunk
+	{
+		size_t Offset; // in bytes from the start of the source
+		size_t Line; // line number of the first line of the chunk
+	};
 
+	// Returns the chunks the source can be split into so that they can be parsed independently: the chunks
+	// start at a line outside any braces, comment, string or directive, after a ';' or '}'
+	std::vector<sChunk> FindChunks(size_t maxChunks) const;
+	sParsedEffect ParseChunk(std::string_view chunk, const sChunk& start) const;
+	// The passes of each chunk refer to the programs in the order they appear in the chunk. Sorts the programs
+	// of all the chunks into `result` and updates the passes to refer to them instead.
+	static void SortPrograms(std::vector<sParsedEffect>& chunks, sParsedEffect& result);
+};
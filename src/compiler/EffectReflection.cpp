@@ -0,0 +1,183 @@
+#include "EffectReflection.h"
+#ifdef _WIN32
+#include <d3dcompiler.h>
+#include <atlbase.h>
+#endif
+#include <stdexcept>
+#include "Effect.h"
+#include "Hash.h"
+
+#ifdef _WIN32
+static uint8_t VarTypeD3D11ToRage(ID3D11ShaderReflectionType* type)
+{
+	enum grcEffectVarType : uint8_t
+	{
+		float_ = 2,
+		float2 = 3,
+		float3 = 4,
+		float4 = 5,
+		texture = 6,
+		bool_ = 7,
+		float3x4 = 8,
+		float4x4 = 9,
+		string = 10,
+		int_ = 11,
+		int2 = 12,
+		int3 = 13,
+		int4 = 14,
+	};
+
+	D3D11_SHADER_TYPE_DESC typeDesc;
+	type->GetDesc(&typeDesc);
+
+	switch (typeDesc.Type)
+	{
+	case D3D_SVT_FLOAT:
+	{
+		if (typeDesc.Class == D3D_SVC_MATRIX_ROWS || typeDesc.Class == D3D_SVC_MATRIX_COLUMNS)
+		{
+			if (typeDesc.Rows == 3 && typeDesc.Columns == 4)
+			{
+				return grcEffectVarType::float3x4;
+			}
+			else if (typeDesc.Rows == 4 && typeDesc.Columns == 4)
+			{
+				return grcEffectVarType::float4x4;
+			}
+		}
+		else
+		{
+			switch (typeDesc.Columns)
+			{
+			case 1: return grcEffectVarType::float_;
+			case 2: return grcEffectVarType::float2;
+			case 3: return grcEffectVarType::float3;
+			case 4: return grcEffectVarType::float4;
+			}
+		}
+		break;
+	}
+	case D3D_SVT_INT:
+	case D3D_SVT_UINT:
+	{
+		switch (typeDesc.Columns)
+		{
+		case 1: return grcEffectVarType::int_;
+		case 2: return grcEffectVarType::int2;
+		case 3: return grcEffectVarType::int3;
+		case 4: return grcEffectVarType::int4;
+		}
+		break;
+	}
+	case D3D_SVT_STRING:
+		return grcEffectVarType::string;
+	case D3D_SVT_BOOL:
+		return grcEffectVarType::bool_;
+	case D3D_SVT_TEXTURE:
+	case D3D_SVT_TEXTURE1D:
+	case D3D_SVT_TEXTURE2D:
+	case D3D_SVT_TEXTURE3D:
+	case D3D_SVT_TEXTURECUBE:
+	case D3D_SVT_SAMPLER:
+	case D3D_SVT_SAMPLER1D:
+	case D3D_SVT_SAMPLER2D:
+	case D3D_SVT_SAMPLER3D:
+	case D3D_SVT_SAMPLERCUBE:
+		return grcEffectVarType::texture;
+	}
+
+	// TODO: support more variable types
+	throw std::runtime_error("Unsupported variable type '" + std::to_string(typeDesc.Type) + "'");
+}
+
+#endif
+
+sProgramReflection ReflectProgram(const CCodeBlob& code)
+{
+	sProgramReflection result;
+
+#ifdef _WIN32
+	CComPtr<ID3D11ShaderReflection> reflection;
+	HRESULT r = D3DReflect(code.Data(), code.Size(), __uuidof(ID3D11ShaderReflection), reinterpret_cast<void**>(&reflection));
+	if (FAILED(r))
+	{
+		return result;
+	}
+
+	D3D11_SHADER_DESC shaderDesc;
+	if (FAILED(reflection->GetDesc(&shaderDesc)))
+	{
+		return result;
+	}
+
+	// constant buffers and their variables
+	result.Buffers.reserve(shaderDesc.ConstantBuffers);
+	for (uint32_t i = 0; i < shaderDesc.ConstantBuffers; i++)
+	{
+		ID3D11ShaderReflectionConstantBuffer* buffer = reflection->GetConstantBufferByIndex(i);
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		buffer->GetDesc(&bufferDesc);
+
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc = {};
+		reflection->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		sReflectedBuffer& b = result.Buffers.emplace_back();
+		b.Name = bufferDesc.Name;
+		b.NameHash = joaat(b.Name);
+		b.Size = bufferDesc.Size;
+		b.Register = bindDesc.BindPoint;
+
+		for (uint32_t j = 0; j < bufferDesc.Variables; j++)
+		{
+			ID3D11ShaderReflectionVariable* var = buffer->GetVariableByIndex(j);
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			var->GetDesc(&varDesc);
+
+			ID3D11ShaderReflectionType* varType = var->GetType();
+			D3D11_SHADER_TYPE_DESC varTypeDesc;
+			varType->GetDesc(&varTypeDesc);
+
+			sReflectedVariable& v = result.Variables.emplace_back();
+			v.Name = varDesc.Name;
+			v.BufferIndex = i;
+			v.Offset = varDesc.StartOffset;
+			v.Count = varTypeDesc.Elements;
+			v.Type = VarTypeD3D11ToRage(varType);
+
+			if (varDesc.DefaultValue) // if has default values
+			{
+				// if is the size is not aligned to 4 bytes, throw error
+				if ((varDesc.Size & 3) != 0)
+				{
+					// TODO: is it possible for variables to not be 4-byte aligned?
+					throw std::runtime_error("Size of variable '" + v.Name + "' is not 4-byte aligned");
+				}
+				else
+				{
+					const uint32_t* values = reinterpret_cast<uint32_t*>(varDesc.DefaultValue);
+					const size_t numValues = varDesc.Size / 4;
+					v.InitialValues.assign(values, values + numValues);
+				}
+			}
+		}
+	}
+
+	// texture/sampler resources
+	for (uint32_t i = 0; i < shaderDesc.BoundResources; i++)
+	{
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		reflection->GetResourceBindingDesc(i, &bindDesc);
+
+		if (bindDesc.Type == D3D_SIT_SAMPLER || bindDesc.Type == D3D_SIT_TEXTURE)
+		{
+			sReflectedResource& res = result.Resources.emplace_back();
+			res.Name = bindDesc.Name;
+			res.BindPoint = bindDesc.BindPoint;
+			res.IsTexture = bindDesc.Type == D3D_SIT_TEXTURE;
+		}
+	}
+
+#endif
+
+	return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CCodeBlob;
+
+struct sReflectedBuffer
+{
+	std::string Name;
+	uint32_t NameHash = 0;
+	uint32_t Size = 0;
+	uint32_t Register = 0;
+};
+
+struct sReflectedVariable
+{
+	std::string Name;
+	uint32_t BufferIndex = 0; // index in sProgramReflection::Buffers
+	uint32_t Offset = 0;
+	uint32_t Count = 0;
+	uint8_t Type = 0;
+	std::vector<uint32_t> InitialValues;
+};
+
+// Texture or sampler bound to the program
+struct sReflectedResource
+{
+	std::string Name;
+	uint32_t BindPoint = 0;
+	bool IsTexture = false;
+};
+
+// Summary of the D3DReflect information used by CEffectSaver, built once per compiled program
+struct sProgramReflection
+{
+	std::vector<sReflectedBuffer> Buffers;
+	std::vector<sReflectedVariable> Variables;	// constant buffer variables, in buffer order
+	std::vector<sReflectedResource> Resources;	// in binding order
+};
+
+// Returns an empty reflection if the code cannot be reflected, always the case on platforms without the D3D compiler
+sProgramReflection ReflectProgram(const CCodeBlob& code);
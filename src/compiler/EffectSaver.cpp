@@ -2,63 +2,14 @@
 #include <assert.h>
 #include <fstream>
 #include <vector>
-#include <d3dcompiler.h>
-#include <atlbase.h>
 #include <tuple>
 #include <set>
 #include "Effect.h"
-#include "Hash.h"
+#include "BinaryWriter.h"
+#include "Trace.h"
 
 namespace fs = std::filesystem;
 
-CEffectSaver::CEffectSaver(const CEffect& effect)
-	: mEffect(effect)
-{
-}
-
-void CEffectSaver::SaveTo(const fs::path& filePath) const
-{
-	if (!filePath.has_filename())
-	{
-		throw std::invalid_argument("Path '" + filePath.string() + "' is not a valid file path");
-	}
-
-	fs::path fullPath = fs::absolute(filePath);
-	if (!fs::exists(fullPath.parent_path()))
-	{
-		throw std::invalid_argument("Parent path '" + fullPath.parent_path().string() + "' does not exist");
-	}
-
-	std::ofstream f(fullPath, std::ios_base::out | std::ios_base::binary);
-
-	WriteHeader(f);
-	WriteAnnotations(f);
-	WritePrograms(f, eProgramType::Vertex);
-	WritePrograms(f, eProgramType::Fragment);
-	WritePrograms(f, eProgramType::Compute);
-	WritePrograms(f, eProgramType::Domain);
-	WritePrograms(f, eProgramType::Geometry);
-	WritePrograms(f, eProgramType::Hull);
-	WriteBuffers(f, true);
-	WriteBuffers(f, false);
-	WriteTechniques(f);
-
-	// TODO: finish CEffectSaver::SaveTo
-}
-
-void CEffectSaver::WriteHeader(std::ostream& o) const
-{
-	constexpr uint32_t Header = ('r' << 0) | ('g' << 8) | ('x' << 16) | ('e' << 24);
-
-	WriteUInt32(o, Header);
-	WriteUInt32(o, 0xDEADBEEF); // TODO: vertex type
-}
-
-void CEffectSaver::WriteAnnotations(std::ostream& o) const
-{
-	WriteUInt8(o, 0); // no annotations support for now
-}
-
 struct sBufferDesc
 {
 	std::string Name;
@@ -94,268 +45,254 @@ struct sVariableDesc
 	};
 };
 
-static uint8_t VarTypeD3D11ToRage(ID3D11ShaderReflectionType* type)
+using tBufferDescSet = std::set<sBufferDesc, sBufferDesc::Comparer>;
+using tVariableDescSet = std::set<sVariableDesc, sVariableDesc::Comparer>;
+
+struct sProgramSaveData
 {
-	enum grcEffectVarType : uint8_t
-	{
-		float_ = 2,
-		float2 = 3,
-		float3 = 4,
-		float4 = 5,
-		texture = 6,
-		bool_ = 7,
-		float3x4 = 8,
-		float4x4 = 9,
-		string = 10,
-		int_ = 11,
-		int2 = 12,
-		int3 = 13,
-		int4 = 14,
-	};
+	std::string Name;
+	const CCodeBlob* Code = nullptr;
+	tBufferDescSet Buffers;
+	tVariableDescSet Variables;
+};
+
+// Everything CEffectSaver writes that requires some processing, gathered once before sizing and writing the file
+struct sEffectSaveData
+{
+	std::vector<sProgramSaveData> Programs[static_cast<size_t>(eProgramType::NumberOfTypes)];
+	tBufferDescSet GlobalBuffers, LocalBuffers;
+	tVariableDescSet GlobalVariables, LocalVariables;
+};
 
-	D3D11_SHADER_TYPE_DESC typeDesc;
-	type->GetDesc(&typeDesc);
+// globals: include shared buffers and variables
+// locals: include non-shared buffers and variables
+static bool IsVariableIncluded(bool isShared, bool globals, bool locals)
+{
+	return (globals && isShared) || (locals && !isShared);
+}
 
-	switch (typeDesc.Type)
-	{
-	case D3D_SVT_FLOAT:
+static void GetBuffersDesc(const CEffect& effect, const sProgramReflection& reflection, tBufferDescSet& outBuffers, bool globals, bool locals)
+{
+	for (const auto& b : reflection.Buffers)
 	{
-		if (typeDesc.Class == D3D_SVC_MATRIX_ROWS || typeDesc.Class == D3D_SVC_MATRIX_COLUMNS)
+		if (IsVariableIncluded(effect.IsSharedVariable(b.Name), globals, locals))
 		{
-			if (typeDesc.Rows == 3 && typeDesc.Columns == 4)
-			{
-				return grcEffectVarType::float3x4;
-			}
-			else if (typeDesc.Rows == 4 && typeDesc.Columns == 4)
-			{
-				return grcEffectVarType::float4x4;
-			}
+			sBufferDesc d;
+			d.Name = b.Name;
+			d.Size = b.Size;
+			d.Register = b.Register;
+
+			outBuffers.insert(d);
 		}
-		else
+	}
+}
+
+static void GetVarsDesc(const CEffect& effect, const sProgramReflection& reflection, tVariableDescSet& outVars, bool globals, bool locals)
+{
+	// get variables from constant buffers
+	for (const auto& var : reflection.Variables)
+	{
+		const sReflectedBuffer& buffer = reflection.Buffers[var.BufferIndex];
+		if (IsVariableIncluded(effect.IsSharedVariable(buffer.Name), globals, locals))
 		{
-			switch (typeDesc.Columns)
-			{
-			case 1: return grcEffectVarType::float_;
-			case 2: return grcEffectVarType::float2;
-			case 3: return grcEffectVarType::float3;
-			case 4: return grcEffectVarType::float4;
-			}
+			// TODO: buffer variables require more data for WriteBuffers
+			sVariableDesc v;
+			v.Name = var.Name;
+			v.Offset = var.Offset;
+			v.Count = var.Count;
+			v.Flags1 = 0;
+			v.Flags2 = 0;
+			v.Type = var.Type;
+			v.BufferNameHash = buffer.NameHash;
+			v.InitialValues = var.InitialValues;
+
+			outVars.insert(v);
 		}
-		break;
 	}
-	case D3D_SVT_INT:
-	case D3D_SVT_UINT:
+
+	// get texture/sampler variables
+	for (const auto& res : reflection.Resources)
 	{
-		switch (typeDesc.Columns)
+		if (IsVariableIncluded(effect.IsSharedVariable(res.Name), globals, locals))
 		{
-		case 1: return grcEffectVarType::int_;
-		case 2: return grcEffectVarType::int2;
-		case 3: return grcEffectVarType::int3;
-		case 4: return grcEffectVarType::int4;
+			sVariableDesc v;
+			v.Name = res.Name;
+			v.Offset = res.BindPoint;
+			v.Count = 0;
+			v.Flags1 = static_cast<uint8_t>(res.BindPoint + (res.IsTexture ? 64 : 0));
+			v.Flags2 = 0;
+			v.Type = 6; // texture
+			v.BufferNameHash = 0;
+
+			if (const sSamplerState* sampler = effect.FindSamplerState(res.Name))
+			{
+				v.InitialValues.reserve(sampler->Assignments.size() * 2);
+				for (auto& a : sampler->Assignments)
+				{
+					v.InitialValues.push_back(static_cast<uint32_t>(a.Type) - static_cast<uint32_t>(eAssignmentType::SamplerStateOffset));
+					v.InitialValues.push_back(a.Value);
+				}
+			}
+
+			outVars.insert(v);
 		}
-		break;
-	}
-	case D3D_SVT_STRING:
-		return grcEffectVarType::string;
-	case D3D_SVT_BOOL:
-		return grcEffectVarType::bool_;
-	case D3D_SVT_TEXTURE:
-	case D3D_SVT_TEXTURE1D:
-	case D3D_SVT_TEXTURE2D:
-	case D3D_SVT_TEXTURE3D:
-	case D3D_SVT_TEXTURECUBE:
-	case D3D_SVT_SAMPLER:
-	case D3D_SVT_SAMPLER1D:
-	case D3D_SVT_SAMPLER2D:
-	case D3D_SVT_SAMPLER3D:
-	case D3D_SVT_SAMPLERCUBE:
-		return grcEffectVarType::texture;
 	}
+}
 
-	// TODO: support more variable types
-	throw std::runtime_error("Unsupported variable type '" + std::to_string(typeDesc.Type) + "'");
+CEffectSaver::CEffectSaver(const CEffect& effect)
+	: mEffect(effect)
+{
 }
 
-static void GetBuffersDesc(const CEffect& effect, const CCodeBlob& code, std::set<sBufferDesc, sBufferDesc::Comparer>& outBuffers, bool globals, bool locals)
+void CEffectSaver::SaveTo(const fs::path& filePath) const
 {
-	CComPtr<ID3D11ShaderReflection> reflection;
-	HRESULT r = D3DReflect(code.Data(), code.Size(), __uuidof(ID3D11ShaderReflection), reinterpret_cast<void**>(&reflection));
-	if (FAILED(r))
+	if (!filePath.has_filename())
 	{
-		return;
+		throw std::invalid_argument("Path '" + filePath.string() + "' is not a valid file path");
 	}
 
-	D3D11_SHADER_DESC shaderDesc;
-	if (FAILED(reflection->GetDesc(&shaderDesc)))
+	fs::path fullPath = fs::absolute(filePath);
+	if (!fs::exists(fullPath.parent_path()))
 	{
-		return;
+		throw std::invalid_argument("Parent path '" + fullPath.parent_path().string() + "' does not exist");
 	}
 
-	for (uint32_t i = 0; i < shaderDesc.ConstantBuffers; i++)
-	{
-		ID3D11ShaderReflectionConstantBuffer* buffer = reflection->GetConstantBufferByIndex(i);
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		buffer->GetDesc(&bufferDesc);
-
-		const std::vector<std::string>& sharedVars = effect.SharedVariables();
-		bool isGlobalBuffer = std::find(sharedVars.begin(), sharedVars.end(), bufferDesc.Name) != sharedVars.end();
-		if ((globals && isGlobalBuffer) || (!globals && !isGlobalBuffer) ||
-			(locals && !isGlobalBuffer) || (!locals && isGlobalBuffer))
-		{
-			D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-			reflection->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
-
-			sBufferDesc d;
-			d.Name = bufferDesc.Name;
-			d.Size = bufferDesc.Size;
-			d.Register = bindDesc.BindPoint;
+	const std::vector<uint8_t> data = SaveToMemory();
 
-			outBuffers.insert(d);
-		}
+	std::ofstream f(fullPath, std::ios_base::out | std::ios_base::binary);
+	f.write(reinterpret_cast<const char*>(data.data()), data.size());
+	if (!f)
+	{
+		throw std::runtime_error("Failed to write file '" + fullPath.string() + "'");
 	}
 }
 
-static void GetVarsDesc(const CEffect& effect, const CCodeBlob& code, std::set<sVariableDesc, sVariableDesc::Comparer>& outVars, bool globals, bool locals)
+std::vector<uint8_t> CEffectSaver::SaveToMemory() const
 {
-	CComPtr<ID3D11ShaderReflection> reflection;
-	HRESULT r = D3DReflect(code.Data(), code.Size(), __uuidof(ID3D11ShaderReflection), reinterpret_cast<void**>(&reflection));
-	if (FAILED(r))
+	const std::string fileName = mEffect.SourceFilename().filename().string();
+
+	sEffectSaveData data;
 	{
-		return;
+		CTraceScope trace("save", "GatherSaveData", fileName);
+		GatherSaveData(data);
 	}
 
-	D3D11_SHADER_DESC shaderDesc;
-	if (FAILED(reflection->GetDesc(&shaderDesc)))
+	// first pass only counts the bytes, so the second pass can write everything to a single allocation
+	CBinaryWriter counter;
 	{
-		return;
+		CTraceScope trace("save", "Measure", fileName);
+		Write(counter, data);
 	}
 
-	// get variables from constant buffers
-	for (uint32_t i = 0; i < shaderDesc.ConstantBuffers; i++)
+	std::vector<uint8_t> buffer(counter.Position());
+	CBinaryWriter writer(buffer.data(), buffer.size());
+	Write(writer, data);
+
+	return buffer;
+}
+
+void CEffectSaver::Write(CBinaryWriter& w, const sEffectSaveData& data) const
+{
+	// the counting pass is traced as a whole by the caller
+	const bool traced = !w.IsCounting() && CTrace::IsEnabled();
+	const std::string fileName = traced ? mEffect.SourceFilename().filename().string() : std::string();
+	auto section = [traced, &fileName](const char* name, auto&& write)
 	{
-		ID3D11ShaderReflectionConstantBuffer* buffer = reflection->GetConstantBufferByIndex(i);
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		buffer->GetDesc(&bufferDesc);
-
-		const std::vector<std::string>& sharedVars = effect.SharedVariables();
-		bool isGlobalBuffer = std::find(sharedVars.begin(), sharedVars.end(), bufferDesc.Name) != sharedVars.end();
-		if ((globals && isGlobalBuffer) || (!globals && !isGlobalBuffer) ||
-			(locals && !isGlobalBuffer) || (!locals && isGlobalBuffer))
+		if (traced)
 		{
-			for (uint32_t j = 0; j < bufferDesc.Variables; j++)
-			{
-				ID3D11ShaderReflectionVariable* var = buffer->GetVariableByIndex(j);
-				D3D11_SHADER_VARIABLE_DESC varDesc;
-				var->GetDesc(&varDesc);
-
-				ID3D11ShaderReflectionType* varType = var->GetType();
-				D3D11_SHADER_TYPE_DESC varTypeDesc;
-				varType->GetDesc(&varTypeDesc);
-
-				// TODO: buffer variables require more data for WriteBuffers
-				sVariableDesc v;
-				v.Name = varDesc.Name;
-				v.Offset = varDesc.StartOffset;
-				v.Count = varTypeDesc.Elements;
-				v.Flags1 = 0;
-				v.Flags2 = 0;
-				v.Type = VarTypeD3D11ToRage(varType);
-				v.BufferNameHash = joaat(bufferDesc.Name);
-
-				if (varDesc.DefaultValue) // if has default values
-				{
-					// if is the size is not aligned to 4 bytes, throw error
-					if ((varDesc.Size & 3) != 0)
-					{
-						// TODO: is it possible for variables to not be 4-byte aligned?
-						throw std::runtime_error("Size of variable '" + v.Name + "' is not 4-byte aligned");
-					}
-					else
-					{
-						const uint32_t* values = reinterpret_cast<uint32_t*>(varDesc.DefaultValue);
-						const size_t numValues = varDesc.Size / 4;
-						v.InitialValues.reserve(numValues);
-						std::copy(values, values + numValues, std::back_inserter(v.InitialValues));
-					}
-				}
-
-				outVars.insert(v);
-			}
+			CTraceScope trace("save", name, fileName);
+			write();
 		}
-	}
+		else
+		{
+			write();
+		}
+	};
 
-	// get texture/sampler variables
-	for (uint32_t i = 0; i < shaderDesc.BoundResources; i++)
+	section("WriteHeader", [&]() { WriteHeader(w); });
+	section("WriteAnnotations", [&]() { WriteAnnotations(w); });
+	section("WritePrograms", [&]()
+	{
+		WritePrograms(w, data, eProgramType::Vertex);
+		WritePrograms(w, data, eProgramType::Fragment);
+		WritePrograms(w, data, eProgramType::Compute);
+		WritePrograms(w, data, eProgramType::Domain);
+		WritePrograms(w, data, eProgramType::Geometry);
+		WritePrograms(w, data, eProgramType::Hull);
+	});
+	section("WriteBuffers", [&]()
+	{
+		WriteBuffers(w, data, true);
+		WriteBuffers(w, data, false);
+	});
+	section("WriteTechniques", [&]() { WriteTechniques(w); });
+
+	// TODO: finish CEffectSaver::Write
+}
+
+void CEffectSaver::WriteHeader(CBinaryWriter& w) const
+{
+	constexpr uint32_t Header = ('r' << 0) | ('g' << 8) | ('x' << 16) | ('e' << 24);
+
+	w.WriteUInt32(Header);
+	w.WriteUInt32(0xDEADBEEF); // TODO: vertex type
+}
+
+void CEffectSaver::WriteAnnotations(CBinaryWriter& w) const
+{
+	w.WriteUInt8(0); // no annotations support for now
+}
+
+void CEffectSaver::GatherSaveData(sEffectSaveData& data) const
+{
+	for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
 	{
-		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-		reflection->GetResourceBindingDesc(i, &bindDesc);
+		const eProgramType type = static_cast<eProgramType>(i);
 
-		const std::vector<std::string>& sharedVars = effect.SharedVariables();
-		bool isGlobal = std::find(sharedVars.begin(), sharedVars.end(), bindDesc.Name) != sharedVars.end();
-		if ((globals && isGlobal) || (!globals && !isGlobal) ||
-			(locals && !isGlobal) || (!locals && isGlobal))
+		for (std::string_view name : mEffect.Programs(type))
 		{
-			if (bindDesc.Type == D3D_SIT_SAMPLER || bindDesc.Type == D3D_SIT_TEXTURE)
-			{
-				std::string name = bindDesc.Name;
-
-				sVariableDesc v;
-				v.Name = name;
-				v.Offset = bindDesc.BindPoint;
-				v.Count = 0;
-				v.Flags1 = static_cast<uint8_t>(bindDesc.BindPoint + (bindDesc.Type == D3D_SIT_TEXTURE ? 64 : 0));
-				v.Flags2 = 0;
-				v.Type = 6; // texture
-				v.BufferNameHash = 0;
-
-				const std::vector<sSamplerState>& samplers = effect.SamplerStates();
-				auto samplerIter = std::find_if(samplers.begin(), samplers.end(),
-					[&name](const sSamplerState& s) -> bool
-					{
-						return s.Name == name;
-					});
-
-				if (samplerIter != samplers.end())
-				{
-					const sSamplerState& sampler = *samplerIter;
-					v.InitialValues.reserve(sampler.Assignments.size() * 2);
-					for (auto& a : sampler.Assignments)
-					{
-						v.InitialValues.push_back(static_cast<uint32_t>(a.Type) - static_cast<uint32_t>(eAssignmentType::SamplerStateOffset));
-						v.InitialValues.push_back(a.Value);
-					}
-				}
+			const std::string e(name);
+			const CCodeBlob& code = mEffect.GetProgramCode(e);
+			const sProgramReflection& reflection = code.Reflection();
 
-				outVars.insert(v);
+			// TODO: WritePrograms for programs other than vertex/fragment
+			if (type == eProgramType::Vertex || type == eProgramType::Fragment)
+			{
+				sProgramSaveData& p = data.Programs[i].emplace_back();
+				p.Name = e;
+				p.Code = &code;
+				GetBuffersDesc(mEffect, reflection, p.Buffers, true, true);
+				GetVarsDesc(mEffect, reflection, p.Variables, true, true);
 			}
+
+			GetBuffersDesc(mEffect, reflection, data.GlobalBuffers, true, false);
+			GetVarsDesc(mEffect, reflection, data.GlobalVariables, true, false);
+			GetBuffersDesc(mEffect, reflection, data.LocalBuffers, false, true);
+			GetVarsDesc(mEffect, reflection, data.LocalVariables, false, true);
 		}
 	}
 }
 
-void CEffectSaver::WritePrograms(std::ostream& o, eProgramType type) const
+void CEffectSaver::WritePrograms(CBinaryWriter& w, const sEffectSaveData& data, eProgramType type) const
 {
 	if (type == eProgramType::Vertex || type == eProgramType::Fragment)
 	{
-		std::set<std::string> entrypoints;
-		mEffect.GetUsedPrograms(entrypoints, type);
+		const std::vector<sProgramSaveData>& programs = data.Programs[static_cast<size_t>(type)];
 
-		if (entrypoints.size() > std::numeric_limits<uint8_t>::max() - 1) // -1 to account for implicit NULL program
+		if (programs.size() > std::numeric_limits<uint8_t>::max() - 1) // -1 to account for implicit NULL program
 		{
 			throw std::length_error("Number of programs exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()));
 		}
 
-		WriteUInt8(o, static_cast<uint8_t>(entrypoints.size() + 1)); // program count
+		w.WriteUInt8(static_cast<uint8_t>(programs.size() + 1)); // program count
 		
-		WriteNullProgram(o, type);
+		WriteNullProgram(w, type);
 
-		for (const auto& e : entrypoints)
+		for (const auto& p : programs)
 		{
-			const CCodeBlob& code = mEffect.GetProgramCode(e);
-			std::set<sBufferDesc, sBufferDesc::Comparer> buffers;
-			GetBuffersDesc(mEffect, code, buffers, true, true);
-
-			std::set<sVariableDesc, sVariableDesc::Comparer> vars;
-			GetVarsDesc(mEffect, code, vars, true, true);
+			const CCodeBlob& code = *p.Code;
+			const tBufferDescSet& buffers = p.Buffers;
+			const tVariableDescSet& vars = p.Variables;
 			
 			if (buffers.size() > std::numeric_limits<uint8_t>::max())
 			{
@@ -367,71 +304,59 @@ void CEffectSaver::WritePrograms(std::ostream& o, eProgramType type) const
 				throw std::length_error("Number of variables exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()));
 			}
 
-			WriteLengthPrefixedString(o, e);
+			WriteLengthPrefixedString(w, p.Name);
 
 			// variables
-			WriteUInt8(o, static_cast<uint8_t>(vars.size())); // var count
+			w.WriteUInt8(static_cast<uint8_t>(vars.size())); // var count
 			for (const auto& v : vars)
 			{
-				WriteLengthPrefixedString(o, v.Name); // var name
+				WriteLengthPrefixedString(w, v.Name); // var name
 			}
 
 			// buffers
-			WriteUInt8(o, static_cast<uint8_t>(buffers.size())); // buffer count
+			w.WriteUInt8(static_cast<uint8_t>(buffers.size())); // buffer count
 			for (const auto& b : buffers)
 			{
-				WriteLengthPrefixedString(o, b.Name); // buffer name
-				WriteUInt8(o, static_cast<uint8_t>(b.Register)); // register
-				WriteUInt8(o, 0); // what does this byte mean?
+				WriteLengthPrefixedString(w, b.Name); // buffer name
+				w.WriteUInt8(static_cast<uint8_t>(b.Register)); // register
+				w.WriteUInt8(0); // what does this byte mean?
 			}
 
 			// bytecode
-			WriteUInt32(o, code.Size());
+			w.WriteUInt32(code.Size());
 			if (code.Size() > 0)
 			{
-				o.write(reinterpret_cast<const char*>(code.Data()), code.Size());
-				WriteUInt8(o, 4); // target version major
-				WriteUInt8(o, 0); // target version minor
+				w.Write(code.Data(), code.Size());
+				w.WriteUInt8(4); // target version major
+				w.WriteUInt8(0); // target version minor
 			}
 		}
 	}
 	else
 	{
 		// TODO: WritePrograms for programs other than vertex/fragment
-		WriteUInt8(o, 1); // program count
+		w.WriteUInt8(1); // program count
 
-		WriteNullProgram(o, type);
+		WriteNullProgram(w, type);
 	}
 }
 
-void CEffectSaver::WriteNullProgram(std::ostream& o, eProgramType type) const
+void CEffectSaver::WriteNullProgram(CBinaryWriter& w, eProgramType type) const
 {
-	WriteLengthPrefixedString(o, CEffect::NullProgramName);
-	WriteUInt8(o, 0); // buffer variable count
-	WriteUInt8(o, 0); // buffer count
+	WriteLengthPrefixedString(w, CEffect::NullProgramName);
+	w.WriteUInt8(0); // buffer variable count
+	w.WriteUInt8(0); // buffer count
 	if (type == eProgramType::Geometry)
 	{
-		WriteUInt8(o, 0); // unk count
+		w.WriteUInt8(0); // unk count
 	}
-	WriteUInt32(o, 0); // bytecode size
+	w.WriteUInt32(0); // bytecode size
 }
 
-void CEffectSaver::WriteBuffers(std::ostream& o, bool globals) const
+void CEffectSaver::WriteBuffers(CBinaryWriter& w, const sEffectSaveData& data, bool globals) const
 {
-	std::set<sBufferDesc, sBufferDesc::Comparer> buffers;
-	std::set<sVariableDesc, sVariableDesc::Comparer> vars;
-	for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
-	{
-		std::set<std::string> programs;
-		mEffect.GetUsedPrograms(programs, static_cast<eProgramType>(i));
-
-		for (const auto& p : programs)
-		{
-			const CCodeBlob& code = mEffect.GetProgramCode(p);
-			GetBuffersDesc(mEffect, code, buffers, globals, !globals);
-			GetVarsDesc(mEffect, code, vars, globals, !globals);
-		}
-	}
+	const tBufferDescSet& buffers = globals ? data.GlobalBuffers : data.LocalBuffers;
+	const tVariableDescSet& vars = globals ? data.GlobalVariables : data.LocalVariables;
 
 	if (buffers.size() > std::numeric_limits<uint8_t>::max())
 	{
@@ -444,82 +369,86 @@ void CEffectSaver::WriteBuffers(std::ostream& o, bool globals) const
 	}
 
 	// buffers
-	WriteUInt8(o, static_cast<uint8_t>(buffers.size()));
+	w.WriteUInt8(static_cast<uint8_t>(buffers.size()));
 	for (auto& b : buffers)
 	{
-		WriteUInt32(o, b.Size);
+		w.WriteUInt32(b.Size);
 		for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
 		{
-			WriteUInt16(o, static_cast<uint16_t>(b.Register));
+			w.WriteUInt16(static_cast<uint16_t>(b.Register));
 		}
-		WriteLengthPrefixedString(o, b.Name);
+		WriteLengthPrefixedString(w, b.Name);
 	}
 
-	WriteUInt8(o, static_cast<uint8_t>(vars.size()));
+	w.WriteUInt8(static_cast<uint8_t>(vars.size()));
 	for (auto& v : vars)
 	{
-		WriteUInt8(o, v.Type); // type
-		WriteUInt8(o, static_cast<uint8_t>(v.Count)); // count
-		WriteUInt8(o, v.Flags1); // flags 1, TODO: variable flags
-		WriteUInt8(o, v.Flags2); // flags 2
-		WriteLengthPrefixedString(o, v.Name); // name
-		WriteLengthPrefixedString(o, v.Name); // description
-		WriteUInt32(o, v.Offset); // offset
-		WriteUInt32(o, v.BufferNameHash); // buffer name hash
-		WriteUInt8(o, 0); // annotation count, no annotations support for now
+		w.WriteUInt8(v.Type); // type
+		w.WriteUInt8(static_cast<uint8_t>(v.Count)); // count
+		w.WriteUInt8(v.Flags1); // flags 1, TODO: variable flags
+		w.WriteUInt8(v.Flags2); // flags 2
+		WriteLengthPrefixedString(w, v.Name); // name
+		WriteLengthPrefixedString(w, v.Name); // description
+		w.WriteUInt32(v.Offset); // offset
+		w.WriteUInt32(v.BufferNameHash); // buffer name hash
+		w.WriteUInt8(0); // annotation count, no annotations support for now
 		
 		if (v.InitialValues.size() > std::numeric_limits<uint8_t>::max())
 		{
 			throw std::length_error("Number of inital values for variable '" + v.Name + "' exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()));
 		}
 
-		WriteUInt8(o, static_cast<uint8_t>(v.InitialValues.size())); // initial values count
+		w.WriteUInt8(static_cast<uint8_t>(v.InitialValues.size())); // initial values count
 		for (uint32_t value : v.InitialValues)
 		{
-			WriteUInt32(o, value);
+			w.WriteUInt32(value);
 		}
 	}
 }
 
-void CEffectSaver::WriteTechniques(std::ostream& o) const
+void CEffectSaver::WriteTechniques(CBinaryWriter& w) const
 {
 	if (mEffect.Techniques().size() > std::numeric_limits<uint8_t>::max())
 	{
 		throw std::length_error("Number of techniques exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()));
 	}
 
-	WriteUInt8(o, static_cast<uint8_t>(mEffect.Techniques().size()));
+	w.WriteUInt8(static_cast<uint8_t>(mEffect.Techniques().size()));
 
 	for (auto& t : mEffect.Techniques())
 	{
-		WriteLengthPrefixedString(o, t.Name);
+		WriteLengthPrefixedString(w, t.Name);
 
 		if (t.Passes.size() > std::numeric_limits<uint8_t>::max())
 		{
 			throw std::length_error("Number of passes exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()));
 		}
 
-		WriteUInt8(o, static_cast<uint8_t>(t.Passes.size())); // pass count
+		w.WriteUInt8(static_cast<uint8_t>(t.Passes.size())); // pass count
 		for (auto& p : t.Passes)
 		{
-			uint8_t programs[static_cast<size_t>(eProgramType::NumberOfTypes)];
-			mEffect.GetPassPrograms(p, programs);
-			for (uint8_t idx : programs)
+			// the program indices are already the ones in the file
+			for (uint16_t idx : p.Programs)
 			{
-				WriteUInt8(o, idx);
+				if (idx > std::numeric_limits<uint8_t>::max())
+				{
+					throw std::length_error("Program index exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()));
+				}
+
+				w.WriteUInt8(static_cast<uint8_t>(idx));
 			}
 
-			WriteUInt8(o, static_cast<uint8_t>(p.Assignments.size())); // assignment count
+			w.WriteUInt8(static_cast<uint8_t>(p.Assignments.size())); // assignment count
 			for (auto& a : p.Assignments)
 			{
-				WriteUInt32(o, static_cast<uint32_t>(a.Type));
-				WriteUInt32(o, a.Value);
+				w.WriteUInt32(static_cast<uint32_t>(a.Type));
+				w.WriteUInt32(a.Value);
 			}
 		}
 	}
 }
 
-void CEffectSaver::WriteLengthPrefixedString(std::ostream& o, const std::string& str) const
+void CEffectSaver::WriteLengthPrefixedString(CBinaryWriter& w, std::string_view str) const
 {
 	size_t length = str.size() + 1; // + null terminator
 	if (length > std::numeric_limits<uint8_t>::max())
@@ -527,22 +456,7 @@ void CEffectSaver::WriteLengthPrefixedString(std::ostream& o, const std::string&
 		throw std::length_error("String length exceeds " + std::to_string(std::numeric_limits<uint8_t>::max()) + " characters");
 	}
 
-	WriteUInt8(o, static_cast<uint8_t>(length));
-	o.write(str.c_str(), str.size());
-	WriteUInt8(o, 0); // null terminator
-}
-
-void CEffectSaver::WriteUInt32(std::ostream& o, uint32_t v) const
-{
-	o.write(reinterpret_cast<char*>(&v), sizeof(uint32_t));
-}
-
-void CEffectSaver::WriteUInt16(std::ostream& o, uint16_t v) const
-{
-	o.write(reinterpret_cast<char*>(&v), sizeof(uint16_t));
-}
-
-void CEffectSaver::WriteUInt8(std::ostream& o, uint8_t v) const
-{
-	o.write(reinterpret_cast<char*>(&v), sizeof(uint8_t));
+	w.WriteUInt8(static_cast<uint8_t>(length));
+	w.Write(str.data(), str.size());
+	w.WriteUInt8(0); // null terminator
 }
@@ -1,9 +1,13 @@
 #pragma once
+#include <stdint.h>
 #include <filesystem>
-#include <ostream>
+#include <string_view>
+#include <vector>
 
 class CEffect;
+class CBinaryWriter;
 enum class eProgramType;
+struct sEffectSaveData;
 
 class CEffectSaver
 {
@@ -14,18 +18,20 @@ public:
 	CEffectSaver(const CEffect& effect);
 
 	void SaveTo(const std::filesystem::path& filePath) const;
+	// Returns the contents of the .fxc file
+	std::vector<uint8_t> SaveToMemory() const;
 
 private:
-	void WriteHeader(std::ostream& o) const;
-	void WriteAnnotations(std::ostream& o) const;
-	void WritePrograms(std::ostream& o, eProgramType type) const;
-	void WriteBuffers(std::ostream& o, bool globals) const;
-	void WriteTechniques(std::ostream& o) const;
-
-	void WriteNullProgram(std::ostream& o, eProgramType type) const;
-
-	void WriteLengthPrefixedString(std::ostream& o, const std::string& str) const;
-	void WriteUInt32(std::ostream& o, uint32_t v) const;
-	void WriteUInt16(std::ostream& o, uint16_t v) const;
-	void WriteUInt8(std::ostream& o, uint8_t v) const;
+	void GatherSaveData(sEffectSaveData& data) const;
+
+	void Write(CBinaryWriter& w, const sEffectSaveData& data) const;
+	void WriteHeader(CBinaryWriter& w) const;
+	void WriteAnnotations(CBinaryWriter& w) const;
+	void WritePrograms(CBinaryWriter& w, const sEffectSaveData& data, eProgramType type) const;
+	void WriteBuffers(CBinaryWriter& w, const sEffectSaveData& data, bool globals) const;
+	void WriteTechniques(CBinaryWriter& w) const;
+
+	void WriteNullProgram(CBinaryWriter& w, eProgramType type) const;
+
+	void WriteLengthPrefixedString(CBinaryWriter& w, std::string_view str) const;
 };
@@ -0,0 +1,228 @@
+#include "EffectScanner.h"
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include "Cpu.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+static inline bool IsIdentifierFirst(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Same characters as pegtl::ascii::space
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+static inline bool IsCandidateCharacter(char c)
+{
+	return c == 't' || c == 's' || c == 'S' || c == '/' || c == '#';
+}
+
+#if CPU_X86
+static inline uint32_t CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+CEffectScanner::CEffectScanner(std::string_view source, eKernel kernel)
+	: mBegin(source.data()), mEnd(source.data() + source.size()), mKernel(kernel)
+{
+	if (!IsSupported(kernel))
+	{
+		throw std::invalid_argument(std::string("Scanner kernel '") + GetKernelName(kernel) + "' is not supported by this CPU");
+	}
+}
+
+const char* CEffectScanner::Next(const char* from) const
+{
+	switch (mKernel)
+	{
+	case eKernel::AVX2: return NextAVX2(from);
+	case eKernel::SSE2: return NextSSE2(from);
+	default: return NextScalar(from, from);
+	}
+}
+
+const char* CEffectScanner::Check(const char* from, const char* p) const
+{
+	const char c = *p;
+	if (c == '/')
+	{
+		// may start a comment
+		return p;
+	}
+	else if (c == '#')
+	{
+		// a directive starts at the beginning of a line and may be preceded by whitespace, including empty
+		// lines, so the candidate is the first line start in the whitespace before it
+		const char* spaceBegin = p;
+		while (spaceBegin > mBegin && IsSpace(spaceBegin[-1]))
+		{
+			spaceBegin--;
+		}
+
+		for (const char* l = spaceBegin < from ? from : spaceBegin; l <= p; l++)
+		{
+			if (l == mBegin || l[-1] == '\n')
+			{
+				return l;
+			}
+		}
+		return nullptr;
+	}
+	else
+	{
+		// a keyword, only if it starts a token. Digits are skipped one at a time by the grammar, so a keyword
+		// right after them still starts a token, unless the digits are part of an identifier.
+		const char* tokenBegin = p;
+		while (tokenBegin > mBegin && IsDigit(tokenBegin[-1]))
+		{
+			tokenBegin--;
+		}
+
+		return tokenBegin == mBegin || !IsIdentifierFirst(tokenBegin[-1]) ? p : nullptr;
+	}
+}
+
+const char* CEffectScanner::NextScalar(const char* from, const char* p) const
+{
+	for (; p < mEnd; p++)
+	{
+		if (IsCandidateCharacter(*p))
+		{
+			if (const char* candidate = Check(from, p))
+			{
+				return candidate;
+			}
+		}
+	}
+
+	return mEnd;
+}
+
+const char* CEffectScanner::NextSSE2(const char* from) const
+{
+#if CPU_X86
+	const __m128i t = _mm_set1_epi8('t');
+	const __m128i s = _mm_set1_epi8('s');
+	const __m128i S = _mm_set1_epi8('S');
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i hash = _mm_set1_epi8('#');
+
+	const char* p = from;
+	for (; p + 16 <= mEnd; p += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		const __m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, t), _mm_cmpeq_epi8(v, s)),
+			_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, S), _mm_cmpeq_epi8(v, slash)), _mm_cmpeq_epi8(v, hash))
+		);
+
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(m));
+		while (mask != 0)
+		{
+			if (const char* candidate = Check(from, p + CountTrailingZeros(mask)))
+			{
+				return candidate;
+			}
+			mask &= mask - 1;
+		}
+	}
+
+	return NextScalar(from, p);
+#else
+	return NextScalar(from, from);
+#endif
+}
+
+CPU_TARGET_AVX2
+const char* CEffectScanner::NextAVX2(const char* from) const
+{
+#if CPU_X86
+	const __m256i t = _mm256_set1_epi8('t');
+	const __m256i s = _mm256_set1_epi8('s');
+	const __m256i S = _mm256_set1_epi8('S');
+	const __m256i slash = _mm256_set1_epi8('/');
+	const __m256i hash = _mm256_set1_epi8('#');
+
+	const char* p = from;
+	for (; p + 32 <= mEnd; p += 32)
+	{
+		const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		const __m256i m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, t), _mm256_cmpeq_epi8(v, s)),
+			_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, S), _mm256_cmpeq_epi8(v, slash)), _mm256_cmpeq_epi8(v, hash))
+		);
+
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+		while (mask != 0)
+		{
+			if (const char* candidate = Check(from, p + CountTrailingZeros(mask)))
+			{
+				return candidate;
+			}
+			mask &= mask - 1;
+		}
+	}
+
+	return NextScalar(from, p);
+#else
+	return NextScalar(from, from);
+#endif
+}
+
+bool CEffectScanner::IsSupported(eKernel kernel)
+{
+	switch (kernel)
+	{
+	case eKernel::Scalar:
+		return true;
+#if CPU_X86
+	case eKernel::SSE2:
+		return true; // part of x86-64
+	case eKernel::AVX2:
+		return IsAVX2Supported();
+#endif
+	default:
+		return false;
+	}
+}
+
+CEffectScanner::eKernel CEffectScanner::BestKernel()
+{
+	return IsSupported(eKernel::AVX2) ? eKernel::AVX2 :
+		   IsSupported(eKernel::SSE2) ? eKernel::SSE2 :
+		   eKernel::Scalar;
+}
+
+const char* CEffectScanner::GetKernelName(eKernel kernel)
+{
+	switch (kernel)
+	{
+	case eKernel::Scalar: return "scalar";
+	case eKernel::SSE2: return "sse2";
+	case eKernel::AVX2: return "avx2";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string_view>
+
+// Finds the positions of a preprocessed source where the effect grammar can match something other than
+// skipped text: a technique, sampler state or shared variable keyword at the start of a token, a comment
+// or a preprocessor directive. The grammar skips straight to them instead of trying its rules at every token.
+class CEffectScanner
+{
+public:
+	enum class eKernel
+	{
+		Scalar = 0,
+		SSE2,
+		AVX2,
+	};
+
+private:
+	const char* mBegin;
+	const char* mEnd;
+	eKernel mKernel;
+
+public:
+	// kernel: must be supported by the CPU, see IsSupported
+	CEffectScanner(std::string_view source, eKernel kernel = BestKernel());
+
+	// Returns the first candidate position at or after `from`, or the end of the source if there are no more.
+	// `from` must be a position the grammar reached, the characters before it are used to tell if a keyword
+	// starts a token.
+	const char* Next(const char* from) const;
+
+	inline eKernel Kernel() const { return mKernel; }
+
+	static bool IsSupported(eKernel kernel);
+	static eKernel BestKernel();
+	static const char* GetKernelName(eKernel kernel);
+
+private:
+	// Returns the candidate position for the character at `p`, or null if it is not a candidate
+	const char* Check(const char* from, const char* p) const;
+
+	const char* NextScalar(const char* from, const char* p) const;
+	const char* NextSSE2(const char* from) const;
+	const char* NextAVX2(const char* from) const;
+};
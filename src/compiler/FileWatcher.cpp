@@ -0,0 +1,132 @@
+#include "FileWatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	constexpr auto PollInterval = std::chrono::milliseconds(200);
+	// editors may write a file in multiple steps, wait a bit to report them as a single change
+	constexpr auto SettleDelay = std::chrono::milliseconds(50);
+}
+
+bool CFileWatcher::sFileState::operator==(const sFileState& other) const
+{
+	return Exists == other.Exists && (!Exists || (LastWriteTime == other.LastWriteTime && Size == other.Size));
+}
+
+CFileWatcher::CFileWatcher()
+{
+#ifdef __linux__
+	mNotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (mNotifyFd < 0)
+	{
+		throw std::runtime_error("Failed to initialize inotify");
+	}
+#endif
+}
+
+CFileWatcher::~CFileWatcher()
+{
+#ifdef __linux__
+	close(mNotifyFd);
+#endif
+}
+
+void CFileWatcher::SetFiles(const std::vector<fs::path>& files)
+{
+	std::unordered_map<fs::path::string_type, sFileState> newFiles;
+	for (const auto& f : files)
+	{
+		newFiles.try_emplace(f.native(), GetState(f));
+
+#ifdef __linux__
+		// watch the directory instead of the file, editors often replace the file when saving it
+		const fs::path dir = f.parent_path();
+		if (mWatchedDirectories.insert(dir).second)
+		{
+			inotify_add_watch(mNotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+		}
+#endif
+	}
+
+	mFiles = std::move(newFiles);
+}
+
+std::vector<fs::path> CFileWatcher::WaitForChanges()
+{
+	while (true)
+	{
+		Wait();
+
+		std::vector<fs::path> changed = Update();
+		if (!changed.empty())
+		{
+			std::this_thread::sleep_for(SettleDelay);
+			for (auto& p : Update())
+			{
+				if (std::find(changed.begin(), changed.end(), p) == changed.end())
+				{
+					changed.push_back(std::move(p));
+				}
+			}
+			return changed;
+		}
+	}
+}
+
+void CFileWatcher::Wait()
+{
+#ifdef __linux__
+	// the events only tell that something changed in the directories, the file states are compared
+	// afterwards. Also wake up periodically in case a directory could not be watched.
+	pollfd fd{ mNotifyFd, POLLIN, 0 };
+	if (poll(&fd, 1, 1000) > 0)
+	{
+		char buffer[4096];
+		while (read(mNotifyFd, buffer, sizeof(buffer)) > 0)
+		{
+		}
+	}
+#else
+	std::this_thread::sleep_for(PollInterval);
+#endif
+}
+
+std::vector<fs::path> CFileWatcher::Update()
+{
+	std::vector<fs::path> changed;
+	for (auto& [key, state] : mFiles)
+	{
+		sFileState newState = GetState(state.Path);
+		if (!(newState == state))
+		{
+			changed.push_back(state.Path);
+			state = std::move(newState);
+		}
+	}
+	return changed;
+}
+
+CFileWatcher::sFileState CFileWatcher::GetState(const fs::path& path)
+{
+	sFileState s;
+	s.Path = path;
+
+	std::error_code ec;
+	s.LastWriteTime = fs::last_write_time(path, ec);
+	if (!ec)
+	{
+		s.Size = fs::file_size(path, ec);
+		s.Exists = !ec;
+	}
+	return s;
+}
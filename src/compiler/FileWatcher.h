@@ -0,0 +1,44 @@
+#pragma once
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// Detects changes to a set of files. On Linux, inotify is used to wait for changes in the
+// directories of the files, on other platforms the files are polled.
+class CFileWatcher
+{
+private:
+	struct sFileState
+	{
+		std::filesystem::path Path;
+		bool Exists = false;
+		std::filesystem::file_time_type LastWriteTime;
+		uintmax_t Size = 0;
+
+		bool operator==(const sFileState& other) const;
+	};
+
+	std::unordered_map<std::filesystem::path::string_type, sFileState> mFiles;
+#ifdef __linux__
+	int mNotifyFd;
+	std::set<std::filesystem::path> mWatchedDirectories;
+#endif
+
+public:
+	CFileWatcher();
+	~CFileWatcher();
+	CFileWatcher(const CFileWatcher&) = delete;
+	CFileWatcher& operator=(const CFileWatcher&) = delete;
+
+	// Replaces the watched files, changes are detected from their current state
+	void SetFiles(const std::vector<std::filesystem::path>& files);
+	// Blocks until at least one of the watched files is modified, created or removed, and returns them
+	std::vector<std::filesystem::path> WaitForChanges();
+
+private:
+	void Wait();
+	std::vector<std::filesystem::path> Update();
+
+	static sFileState GetState(const std::filesystem::path& path);
+};
@@ -1,6 +1,16 @@
 #include "Hash.h"
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "Cpu.h"
 
-static uint8_t joaatNormalizeCaseAndSlash[256] =
+#if CPU_X86
+#include <immintrin.h>
+#endif
+
+static constexpr uint8_t joaatNormalizeCaseAndSlash[256] =
 {
 	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
 	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19,	0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
@@ -20,12 +30,31 @@ static uint8_t joaatNormalizeCaseAndSlash[256] =
 	0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7,	0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF,
 };
 
+static constexpr bool IsJoaatTableNormalized()
+{
+	for (int c = 0; c < 256; c++)
+	{
+		if (joaatNormalizeCaseAndSlash[c] != joaatNormalizeCharacter(static_cast<uint8_t>(c)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// joaat and joaat_constexpr must return the same hashes
+static_assert(IsJoaatTableNormalized(), "joaat table doesn't match joaatNormalizeCharacter");
+static_assert(""_joaat == 0);
+static_assert("adder"_joaat == 0xB779A091);
+static_assert("ADDER"_joaat == "adder"_joaat);
+static_assert("common\\shaders"_joaat == "common/shaders"_joaat);
+
 uint32_t joaat(std::string_view str)
 {
 	uint32_t hash = 0;
 	for (char c : str)
 	{
-		hash += joaatNormalizeCaseAndSlash[c];
+		hash += joaatNormalizeCaseAndSlash[static_cast<uint8_t>(c)];
 		hash += hash << 10;
 		hash ^= hash >> 6;
 	}
@@ -34,3 +63,498 @@ uint32_t joaat(std::string_view str)
 	hash += hash << 15;
 	return hash;
 }
+
+static void JoaatManyScalar(const std::string_view* strings, uint32_t* outHashes, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		outHashes[i] = joaat(strings[i]);
+	}
+}
+
+#if CPU_X86
+// Returns 4 bytes of the string starting at `offset`, little-endian. The string must have them.
+static inline uint32_t LoadFullJoaatWord(std::string_view str, size_t offset)
+{
+	uint32_t word;
+	memcpy(&word, str.data() + offset, sizeof(word));
+	return word;
+}
+
+// Returns up to 4 bytes of the string starting at `offset`, little-endian and padded with zeros
+static inline uint32_t LoadJoaatWord(std::string_view str, size_t offset)
+{
+	if (str.size() >= sizeof(uint32_t))
+	{
+		// without branching on the lane: loads the last 4 bytes instead of reading past the end and
+		// shifts out the ones before `offset`
+		const size_t position = std::min(offset, str.size() - sizeof(uint32_t));
+		const size_t skipped = offset - position;
+		const uint32_t word = LoadFullJoaatWord(str, position);
+		return skipped < sizeof(uint32_t) ? word >> (skipped * 8) : 0;
+	}
+
+	uint32_t word = 0;
+	for (size_t i = offset; i < str.size(); i++)
+	{
+		word |= static_cast<uint32_t>(static_cast<uint8_t>(str[i])) << ((i - offset) * 8);
+	}
+	return word;
+}
+
+// Returns false if any string is too long for the 32-bit lanes
+static inline bool GetJoaatLengths(const std::string_view* strings, size_t count, size_t& outMinLength, size_t& outMaxLength)
+{
+	outMinLength = std::numeric_limits<size_t>::max();
+	outMaxLength = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (strings[i].size() > static_cast<size_t>(std::numeric_limits<int32_t>::max()))
+		{
+			return false;
+		}
+		outMinLength = std::min(outMinLength, strings[i].size());
+		outMaxLength = std::max(outMaxLength, strings[i].size());
+	}
+	return true;
+}
+
+// Each kernel hashes two vectors of strings at a time, so the dependency chains of their steps overlap.
+// While all the strings have 4 more bytes no lane needs to be masked, after that the lanes of the
+// strings that ended keep their hash.
+constexpr size_t JoaatVectors = 2;
+
+// full: all the strings have 4 bytes at `offset`
+static inline __m128i LoadJoaatWordsSSE2(const std::string_view* s, size_t offset, bool full)
+{
+	return full ?
+		_mm_setr_epi32(
+			static_cast<int32_t>(LoadFullJoaatWord(s[0], offset)), static_cast<int32_t>(LoadFullJoaatWord(s[1], offset)),
+			static_cast<int32_t>(LoadFullJoaatWord(s[2], offset)), static_cast<int32_t>(LoadFullJoaatWord(s[3], offset))) :
+		_mm_setr_epi32(
+			static_cast<int32_t>(LoadJoaatWord(s[0], offset)), static_cast<int32_t>(LoadJoaatWord(s[1], offset)),
+			static_cast<int32_t>(LoadJoaatWord(s[2], offset)), static_cast<int32_t>(LoadJoaatWord(s[3], offset)));
+}
+
+// Hashes the lowest byte of each lane of `words`
+static inline __m128i JoaatStepSSE2(__m128i hash, __m128i words)
+{
+	__m128i c = _mm_and_si128(words, _mm_set1_epi32(0xFF));
+
+	// same as joaatNormalizeCharacter
+	const __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi32(c, _mm_set1_epi32('A' - 1)), _mm_cmplt_epi32(c, _mm_set1_epi32('Z' + 1)));
+	c = _mm_add_epi32(c, _mm_and_si128(isUpper, _mm_set1_epi32('a' - 'A')));
+	c = _mm_xor_si128(c, _mm_and_si128(_mm_cmpeq_epi32(c, _mm_set1_epi32('\\')), _mm_set1_epi32('\\' ^ '/')));
+
+	hash = _mm_add_epi32(hash, c);
+	hash = _mm_add_epi32(hash, _mm_slli_epi32(hash, 10));
+	hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 6));
+	return hash;
+}
+
+static inline __m128i JoaatFinishSSE2(__m128i hash)
+{
+	hash = _mm_add_epi32(hash, _mm_slli_epi32(hash, 3));
+	hash = _mm_xor_si128(hash, _mm_srli_epi32(hash, 11));
+	hash = _mm_add_epi32(hash, _mm_slli_epi32(hash, 15));
+	return hash;
+}
+
+static void JoaatManySSE2(const std::string_view* strings, uint32_t* outHashes, size_t count)
+{
+	constexpr size_t Lanes = 4;
+	constexpr size_t Batch = Lanes * JoaatVectors;
+
+	size_t i = 0;
+	for (; i + Batch <= count; i += Batch)
+	{
+		const std::string_view* s = strings + i;
+		size_t minLength, maxLength;
+		if (!GetJoaatLengths(s, Batch, minLength, maxLength))
+		{
+			JoaatManyScalar(s, outHashes + i, Batch);
+			continue;
+		}
+
+		__m128i hash[JoaatVectors];
+		__m128i lengths[JoaatVectors];
+		for (size_t v = 0; v < JoaatVectors; v++)
+		{
+			const std::string_view* vs = s + v * Lanes;
+			hash[v] = _mm_setzero_si128();
+			lengths[v] = _mm_setr_epi32(
+				static_cast<int32_t>(vs[0].size()), static_cast<int32_t>(vs[1].size()),
+				static_cast<int32_t>(vs[2].size()), static_cast<int32_t>(vs[3].size()));
+		}
+
+		size_t offset = 0;
+		for (; offset + 4 <= minLength; offset += 4)
+		{
+			__m128i words[JoaatVectors];
+			for (size_t v = 0; v < JoaatVectors; v++)
+			{
+				words[v] = LoadJoaatWordsSSE2(s + v * Lanes, offset, true);
+			}
+
+			for (size_t j = 0; j < 4; j++)
+			{
+				for (size_t v = 0; v < JoaatVectors; v++)
+				{
+					hash[v] = JoaatStepSSE2(hash[v], words[v]);
+					words[v] = _mm_srli_epi32(words[v], 8);
+				}
+			}
+		}
+
+		for (; offset < maxLength; offset += 4)
+		{
+			__m128i words[JoaatVectors];
+			for (size_t v = 0; v < JoaatVectors; v++)
+			{
+				words[v] = LoadJoaatWordsSSE2(s + v * Lanes, offset, false);
+			}
+
+			const size_t end = std::min(offset + 4, maxLength);
+			for (size_t j = offset; j < end; j++)
+			{
+				const __m128i position = _mm_set1_epi32(static_cast<int32_t>(j));
+				for (size_t v = 0; v < JoaatVectors; v++)
+				{
+					const __m128i active = _mm_cmpgt_epi32(lengths[v], position);
+					const __m128i h = JoaatStepSSE2(hash[v], words[v]);
+					hash[v] = _mm_or_si128(_mm_and_si128(active, h), _mm_andnot_si128(active, hash[v]));
+					words[v] = _mm_srli_epi32(words[v], 8);
+				}
+			}
+		}
+
+		for (size_t v = 0; v < JoaatVectors; v++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(outHashes + i + v * Lanes), JoaatFinishSSE2(hash[v]));
+		}
+	}
+
+	JoaatManyScalar(strings + i, outHashes + i, count - i);
+}
+
+// full: all the strings have 4 bytes at `offset`
+CPU_TARGET_AVX2
+static inline __m256i LoadJoaatWordsAVX2(const std::string_view* s, size_t offset, bool full)
+{
+	return full ?
+		_mm256_setr_epi32(
+			static_cast<int32_t>(LoadFullJoaatWord(s[0], offset)), static_cast<int32_t>(LoadFullJoaatWord(s[1], offset)),
+			static_cast<int32_t>(LoadFullJoaatWord(s[2], offset)), static_cast<int32_t>(LoadFullJoaatWord(s[3], offset)),
+			static_cast<int32_t>(LoadFullJoaatWord(s[4], offset)), static_cast<int32_t>(LoadFullJoaatWord(s[5], offset)),
+			static_cast<int32_t>(LoadFullJoaatWord(s[6], offset)), static_cast<int32_t>(LoadFullJoaatWord(s[7], offset))) :
+		_mm256_setr_epi32(
+			static_cast<int32_t>(LoadJoaatWord(s[0], offset)), static_cast<int32_t>(LoadJoaatWord(s[1], offset)),
+			static_cast<int32_t>(LoadJoaatWord(s[2], offset)), static_cast<int32_t>(LoadJoaatWord(s[3], offset)),
+			static_cast<int32_t>(LoadJoaatWord(s[4], offset)), static_cast<int32_t>(LoadJoaatWord(s[5], offset)),
+			static_cast<int32_t>(LoadJoaatWord(s[6], offset)), static_cast<int32_t>(LoadJoaatWord(s[7], offset)));
+}
+
+// Hashes the lowest byte of each lane of `words`
+CPU_TARGET_AVX2
+static inline __m256i JoaatStepAVX2(__m256i hash, __m256i words)
+{
+	__m256i c = _mm256_and_si256(words, _mm256_set1_epi32(0xFF));
+
+	// same as joaatNormalizeCharacter
+	const __m256i isUpper = _mm256_and_si256(_mm256_cmpgt_epi32(c, _mm256_set1_epi32('A' - 1)), _mm256_cmpgt_epi32(_mm256_set1_epi32('Z' + 1), c));
+	c = _mm256_add_epi32(c, _mm256_and_si256(isUpper, _mm256_set1_epi32('a' - 'A')));
+	c = _mm256_xor_si256(c, _mm256_and_si256(_mm256_cmpeq_epi32(c, _mm256_set1_epi32('\\')), _mm256_set1_epi32('\\' ^ '/')));
+
+	hash = _mm256_add_epi32(hash, c);
+	hash = _mm256_add_epi32(hash, _mm256_slli_epi32(hash, 10));
+	hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 6));
+	return hash;
+}
+
+CPU_TARGET_AVX2
+static inline __m256i JoaatFinishAVX2(__m256i hash)
+{
+	hash = _mm256_add_epi32(hash, _mm256_slli_epi32(hash, 3));
+	hash = _mm256_xor_si256(hash, _mm256_srli_epi32(hash, 11));
+	hash = _mm256_add_epi32(hash, _mm256_slli_epi32(hash, 15));
+	return hash;
+}
+
+CPU_TARGET_AVX2
+static void JoaatManyAVX2(const std::string_view* strings, uint32_t* outHashes, size_t count)
+{
+	constexpr size_t Lanes = 8;
+	constexpr size_t Batch = Lanes * JoaatVectors;
+
+	size_t i = 0;
+	for (; i + Batch <= count; i += Batch)
+	{
+		const std::string_view* s = strings + i;
+		size_t minLength, maxLength;
+		if (!GetJoaatLengths(s, Batch, minLength, maxLength))
+		{
+			JoaatManyScalar(s, outHashes + i, Batch);
+			continue;
+		}
+
+		__m256i hash[JoaatVectors];
+		__m256i lengths[JoaatVectors];
+		for (size_t v = 0; v < JoaatVectors; v++)
+		{
+			const std::string_view* vs = s + v * Lanes;
+			hash[v] = _mm256_setzero_si256();
+			lengths[v] = _mm256_setr_epi32(
+				static_cast<int32_t>(vs[0].size()), static_cast<int32_t>(vs[1].size()),
+				static_cast<int32_t>(vs[2].size()), static_cast<int32_t>(vs[3].size()),
+				static_cast<int32_t>(vs[4].size()), static_cast<int32_t>(vs[5].size()),
+				static_cast<int32_t>(vs[6].size()), static_cast<int32_t>(vs[7].size()));
+		}
+
+		size_t offset = 0;
+		for (; offset + 4 <= minLength; offset += 4)
+		{
+			__m256i words[JoaatVectors];
+			for (size_t v = 0; v < JoaatVectors; v++)
+			{
+				words[v] = LoadJoaatWordsAVX2(s + v * Lanes, offset, true);
+			}
+
+			for (size_t j = 0; j < 4; j++)
+			{
+				for (size_t v = 0; v < JoaatVectors; v++)
+				{
+					hash[v] = JoaatStepAVX2(hash[v], words[v]);
+					words[v] = _mm256_srli_epi32(words[v], 8);
+				}
+			}
+		}
+
+		for (; offset < maxLength; offset += 4)
+		{
+			__m256i words[JoaatVectors];
+			for (size_t v = 0; v < JoaatVectors; v++)
+			{
+				words[v] = LoadJoaatWordsAVX2(s + v * Lanes, offset, false);
+			}
+
+			const size_t end = std::min(offset + 4, maxLength);
+			for (size_t j = offset; j < end; j++)
+			{
+				const __m256i position = _mm256_set1_epi32(static_cast<int32_t>(j));
+				for (size_t v = 0; v < JoaatVectors; v++)
+				{
+					const __m256i active = _mm256_cmpgt_epi32(lengths[v], position);
+					hash[v] = _mm256_blendv_epi8(hash[v], JoaatStepAVX2(hash[v], words[v]), active);
+					words[v] = _mm256_srli_epi32(words[v], 8);
+				}
+			}
+		}
+
+		for (size_t v = 0; v < JoaatVectors; v++)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(outHashes + i + v * Lanes), JoaatFinishAVX2(hash[v]));
+		}
+	}
+
+	JoaatManySSE2(strings + i, outHashes + i, count - i);
+}
+#endif
+
+void joaat_many(const std::string_view* strings, uint32_t* outHashes, size_t count, eJoaatKernel kernel)
+{
+	if (!IsJoaatKernelSupported(kernel))
+	{
+		throw std::invalid_argument(std::string("joaat kernel '") + GetJoaatKernelName(kernel) + "' is not supported by this CPU");
+	}
+
+	switch (kernel)
+	{
+#if CPU_X86
+	case eJoaatKernel::AVX2: JoaatManyAVX2(strings, outHashes, count); break;
+	case eJoaatKernel::SSE2: JoaatManySSE2(strings, outHashes, count); break;
+#endif
+	default: JoaatManyScalar(strings, outHashes, count); break;
+	}
+}
+
+bool IsJoaatKernelSupported(eJoaatKernel kernel)
+{
+	switch (kernel)
+	{
+	case eJoaatKernel::Scalar:
+		return true;
+#if CPU_X86
+	case eJoaatKernel::SSE2:
+		return true; // part of x86-64
+	case eJoaatKernel::AVX2:
+		return IsAVX2Supported();
+#endif
+	default:
+		return false;
+	}
+}
+
+eJoaatKernel BestJoaatKernel()
+{
+	return IsJoaatKernelSupported(eJoaatKernel::AVX2) ? eJoaatKernel::AVX2 :
+		   IsJoaatKernelSupported(eJoaatKernel::SSE2) ? eJoaatKernel::SSE2 :
+		   eJoaatKernel::Scalar;
+}
+
+const char* GetJoaatKernelName(eJoaatKernel kernel)
+{
+	switch (kernel)
+	{
+	case eJoaatKernel::Scalar: return "scalar";
+	case eJoaatKernel::SSE2: return "sse2";
+	case eJoaatKernel::AVX2: return "avx2";
+	default: return "unknown";
+	}
+}
+
+uint64_t fnv1a64(std::string_view data, uint64_t hash)
+{
+	constexpr uint64_t Prime = 0x100000001B3;
+
+	for (char c : data)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= Prime;
+	}
+	return hash;
+}
+
+static constexpr uint32_t Sha256RoundConstants[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static inline uint32_t RotateRight(uint32_t v, uint32_t n)
+{
+	return (v >> n) | (v << (32 - n));
+}
+
+CSha256::CSha256()
+	: mState{ 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 },
+	mBlock{}, mSize(0)
+{
+}
+
+void CSha256::Update(std::string_view data)
+{
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data());
+	size_t remaining = data.size();
+
+	// complete the partial block of the previous calls first
+	size_t used = static_cast<size_t>(mSize % sizeof(mBlock));
+	mSize += remaining;
+	if (used != 0)
+	{
+		const size_t n = std::min(remaining, sizeof(mBlock) - used);
+		memcpy(mBlock + used, p, n);
+		p += n;
+		remaining -= n;
+		used += n;
+		if (used < sizeof(mBlock))
+		{
+			return;
+		}
+		ProcessBlock(mBlock);
+	}
+
+	for (; remaining >= sizeof(mBlock); p += sizeof(mBlock), remaining -= sizeof(mBlock))
+	{
+		ProcessBlock(p);
+	}
+
+	memcpy(mBlock, p, remaining);
+}
+
+tSha256Digest CSha256::Finish()
+{
+	const uint64_t bits = mSize * 8;
+
+	// a single 1 bit, zeros up to 8 bytes before the end of a block, and the length in bits
+	uint8_t padding[sizeof(mBlock) + 8] = { 0x80 };
+	const size_t used = static_cast<size_t>(mSize % sizeof(mBlock));
+	const size_t paddingSize = (used < 56 ? 56 : 120) - used;
+	Update(std::string_view(reinterpret_cast<const char*>(padding), paddingSize));
+
+	uint8_t length[8];
+	for (int i = 0; i < 8; i++)
+	{
+		length[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+	}
+	Update(std::string_view(reinterpret_cast<const char*>(length), sizeof(length)));
+
+	tSha256Digest digest;
+	for (size_t i = 0; i < 8; i++)
+	{
+		digest[i * 4 + 0] = static_cast<uint8_t>(mState[i] >> 24);
+		digest[i * 4 + 1] = static_cast<uint8_t>(mState[i] >> 16);
+		digest[i * 4 + 2] = static_cast<uint8_t>(mState[i] >> 8);
+		digest[i * 4 + 3] = static_cast<uint8_t>(mState[i]);
+	}
+	return digest;
+}
+
+void CSha256::ProcessBlock(const uint8_t* block)
+{
+	uint32_t w[64];
+	for (size_t i = 0; i < 16; i++)
+	{
+		w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+			   (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | static_cast<uint32_t>(block[i * 4 + 3]);
+	}
+	for (size_t i = 16; i < 64; i++)
+	{
+		const uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = mState[0], b = mState[1], c = mState[2], d = mState[3];
+	uint32_t e = mState[4], f = mState[5], g = mState[6], h = mState[7];
+	for (size_t i = 0; i < 64; i++)
+	{
+		const uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+		const uint32_t ch = (e & f) ^ (~e & g);
+		const uint32_t t1 = h + s1 + ch + Sha256RoundConstants[i] + w[i];
+		const uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+		const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		const uint32_t t2 = s0 + maj;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	mState[0] += a; mState[1] += b; mState[2] += c; mState[3] += d;
+	mState[4] += e; mState[5] += f; mState[6] += g; mState[7] += h;
+}
+
+tSha256Digest sha256(std::string_view data)
+{
+	CSha256 sha;
+	sha.Update(data);
+	return sha.Finish();
+}
+
+uint64_t sha256_prefix64(const tSha256Digest& digest)
+{
+	uint64_t v;
+	memcpy(&v, digest.data(), sizeof(v));
+	return v;
+}
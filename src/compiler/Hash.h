@@ -1,5 +1,85 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
+#include <array>
 #include <string_view>
 
+// Jenkins one-at-a-time hash as used by the game: case insensitive and '\' is hashed as '/'
 uint32_t joaat(std::string_view str);
+
+constexpr uint8_t joaatNormalizeCharacter(uint8_t c)
+{
+	return c >= 'A' && c <= 'Z' ? static_cast<uint8_t>(c - 'A' + 'a') :
+		   c == '\\' ? static_cast<uint8_t>('/') :
+		   c;
+}
+
+// Same as joaat, for names known at compile time. joaat is faster at runtime.
+constexpr uint32_t joaat_constexpr(std::string_view str)
+{
+	// computed in 64 bits and masked, the constant evaluation never wraps around (MSVC warns about it)
+	constexpr uint64_t Mask = 0xFFFFFFFF;
+
+	uint64_t hash = 0;
+	for (char c : str)
+	{
+		hash = (hash + joaatNormalizeCharacter(static_cast<uint8_t>(c))) & Mask;
+		hash = (hash + (hash << 10)) & Mask;
+		hash ^= hash >> 6;
+	}
+	hash = (hash + (hash << 3)) & Mask;
+	hash ^= hash >> 11;
+	hash = (hash + (hash << 15)) & Mask;
+	return static_cast<uint32_t>(hash);
+}
+
+// "name"_joaat is the joaat of the name, computed at compile time
+constexpr uint32_t operator""_joaat(const char* str, size_t length)
+{
+	return joaat_constexpr(std::string_view(str, length));
+}
+
+enum class eJoaatKernel
+{
+	Scalar = 0,
+	SSE2,	// 4 strings at a time
+	AVX2,	// 8 strings at a time
+};
+
+bool IsJoaatKernelSupported(eJoaatKernel kernel);
+eJoaatKernel BestJoaatKernel();
+const char* GetJoaatKernelName(eJoaatKernel kernel);
+
+// Hashes `count` strings into `outHashes`, with the same results as joaat. Each string is a serial chain, so
+// the SIMD kernels hash several strings at once, one per lane. Works best when the strings have similar lengths.
+// kernel: must be supported by the CPU, see IsJoaatKernelSupported
+void joaat_many(const std::string_view* strings, uint32_t* outHashes, size_t count, eJoaatKernel kernel = BestJoaatKernel());
+
+// 64-bit FNV-1a, pass a previous result as `hash` to continue hashing multiple buffers
+uint64_t fnv1a64(std::string_view data, uint64_t hash = 0xCBF29CE484222325);
+
+using tSha256Digest = std::array<uint8_t, 32>;
+
+// SHA-256, for the hashes that must not collide, e.g. to check that a persistent cache entry was stored for
+// the same inputs. Update can be called multiple times to hash multiple buffers.
+class CSha256
+{
+private:
+	uint32_t mState[8];
+	uint8_t mBlock[64];
+	uint64_t mSize; // bytes hashed so far
+
+public:
+	CSha256();
+
+	void Update(std::string_view data);
+	tSha256Digest Finish();
+
+private:
+	void ProcessBlock(const uint8_t* block);
+};
+
+tSha256Digest sha256(std::string_view data);
+
+// First 8 bytes of a digest, to key hash tables or name files with it
+uint64_t sha256_prefix64(const tSha256Digest& digest);
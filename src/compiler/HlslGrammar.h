@@ -2,7 +2,9 @@
 #include <tao/pegtl.hpp>
 #include <tao/pegtl/analyze.hpp>
 #include <tao/pegtl/contrib/raw_string.hpp>
+#include <limits>
 #include "Effect.h"
+#include "EffectScanner.h"
 
 namespace pegtl = tao::TAO_PEGTL_NAMESPACE;
 
@@ -37,116 +39,241 @@ namespace hlsl_grammar
 	struct integer_hex : seq<one<'0'>, one<'x'>, plus<xdigit>> {};
 	struct integer : sor<integer_hex, integer_dec> {};
 
+	template<typename Begin, typename Rule, typename End>
+	struct delimited : if_must<Begin, sp_s, Rule, sp_s, End> {};
 	template<typename Rule, char C1, char C2>
-	struct surrounded : if_must<one<C1>, sp_s, Rule, sp_s, one<C2>> {};
+	struct surrounded : delimited<one<C1>, Rule, one<C2>> {};
 	template<typename Rule>
 	struct braces : surrounded<Rule, '{', '}'> {};
 	template<typename Rule>
 	struct parens : surrounded<Rule, '(', ')'> {};
 
-	struct assignment_name : identifier {};
 	struct assignment_value_string : identifier {};
 	struct assignment_value_integer : integer {};
 	struct assignment_value : sor<assignment_value_integer, assignment_value_string> {};
+	// Name and Value are separate rules for pass and sampler state assignments, so they get different actions
+	template<typename Name, typename Value>
 	struct assignment : seq<
-		assignment_name, sp_s,
+		Name, sp_s,
 		one<'='>, sp_s,
-		assignment_value, sp_s,
+		Value, sp_s,
 		one<';'>, sp_s
 	> {};
-	
-	struct pass : seq<str_pass, sp_s, braces<star<assignment>>, sp_s> {};
 
+
+	struct pass_begin : one<'{'> {};
+	struct pass_end : one<'}'> {};
+	struct pass_assignment_name : identifier {};
+	struct pass_assignment_value : assignment_value {};
+	struct pass : seq<
+		str_pass, sp_s,
+		delimited<pass_begin, star<assignment<pass_assignment_name, pass_assignment_value>>, pass_end>, sp_s
+	> {};
+
+	struct technique_begin : one<'{'> {};
+	struct technique_end : one<'}'> {};
 	struct technique_name : identifier {};
-	struct technique : seq<str_technique, sp_p, technique_name, sp_s, braces<star<pass>>, sp_s> {};
+	struct technique : seq<
+		str_technique, sp_p,
+		technique_name, sp_s,
+		delimited<technique_begin, star<pass>, technique_end>, sp_s
+	> {};
+
+
+	struct sampler_type : sor<
+		str_sampler, str_sampler1D, str_sampler2D,
+		str_sampler3D, str_samplerCUBE, str_SamplerState
+	> {};
+	struct sampler_name : identifier {};
+	struct sampler_register : seq<
+		one<':'>, sp_s,
+		str_register, sp_s,
+		parens<
+			seq<alpha, integer_dec>
+		>, sp_s
+	> {};
+	struct sampler_begin : one<'{'> {};
+	struct sampler_end : one<'}'> {};
+	struct sampler_assignment_name : identifier {};
+	struct sampler_assignment_value : assignment_value {};
+	struct sampler_assignments : delimited<
+		sampler_begin, star<assignment<sampler_assignment_name, sampler_assignment_value>>, sampler_end
+	> {};
+	struct sampler : seq<
+		sampler_type, sp_s,
+		sampler_name, sp_s,
+		star<sampler_register>, sp_s,
+		opt<sampler_assignments>, sp_s,
+		one<';'>
+	> {};
+
+
+	struct shared_variable_storage_class : str_shared {};
+	struct shared_variable_type_modifier : sor<
+		str_const, str_row_major, str_column_major
+	> {};
+	struct shared_variable_type : identifier {};
+	struct shared_variable_name : identifier {};
+	// a shared sampler is both a sampler state and a shared variable, its name is added to the shared
+	// variables once the whole sampler matched
+	struct shared_sampler : sampler {};
+	struct shared_variable : seq<
+		shared_variable_storage_class, sp_p,
+		opt<shared_variable_type_modifier>, sp_s,
+		sor<
+			shared_sampler,
+			seq<shared_variable_type, sp_s, shared_variable_name, sp_s>
+		>
+	> {};
+
+
+	struct effect_state;
+
+	// Skips at least one character, up to the next position where the grammar may match something
+	// according to the scanner. Declarations, comments and directives are never tried on the text in between.
+	struct skip_to_candidate
+	{
+		using analyze_t = analysis::generic<analysis::rule_type::ANY>;
+
+		template<apply_mode A, rewind_mode M, template<typename...> class Action, template<typename...> class Control, typename Input>
+		static bool match(Input& in, effect_state& s);
+	};
+
+	// Text that is not part of the effect declarations
+	struct effect_skip : sor<comment, comment_multiline, preprocessor_directive, skip_to_candidate> {};
 
-	struct technique_grammar : star<until<technique>> {};
+	// Extracts the techniques, sampler states and shared variables in a single pass over the source
+	struct effect_grammar : star<sor<technique, sampler, shared_variable, effect_skip>> {};
 
-	struct technique_state
+	struct effect_state
 	{
 		struct sRawAssignment
 		{
-			std::string Type;
-			std::string Value;
+			std::string_view Type;
+			std::string_view Value;
 		};
 
-		int Depth = 0;
+		const CEffectScanner* Scanner = nullptr; // scanner of the input source
 		sTechnique CurrentTechnique;
 		sTechniquePass CurrentPass;
+		sSamplerState CurrentSampler;
 		sRawAssignment CurrentAssignment;
 		std::vector<sTechnique> Techniques;
+		// programs used by the passes, in order of appearance. The passes refer to them by index + 1, until
+		// CEffectParser sorts them.
+		std::vector<std::string_view> Programs[static_cast<size_t>(eProgramType::NumberOfTypes)];
+		std::unordered_map<std::string_view, uint16_t> ProgramIds[static_cast<size_t>(eProgramType::NumberOfTypes)];
+		std::vector<sSamplerState> Samplers;
+		std::vector<std::string_view> SharedVariables;
 	};
 
+	template<apply_mode A, rewind_mode M, template<typename...> class Action, template<typename...> class Control, typename Input>
+	bool skip_to_candidate::match(Input& in, effect_state& s)
+	{
+		if (in.empty())
+		{
+			return false;
+		}
+
+		const char* next = s.Scanner->Next(in.current() + 1);
+		in.bump(static_cast<std::size_t>(next - in.current()));
+		return true;
+	}
+
+	// The matched text, the input is the source itself so it stays valid after parsing
+	template<typename Input>
+	std::string_view matched(const Input& in)
+	{
+		return std::string_view(in.begin(), in.size());
+	}
+
 	template<typename Rule>
-	struct technique_action {};
+	struct effect_action {};
 
 	template<>
-	struct technique_action<one<'{'>>
+	struct effect_action<technique_name>
 	{
 		template<typename Input>
-		static void apply(const Input& /* in */, technique_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.Depth++;
-
-			if (s.Depth == 1) // enters technique
-			{
-				// CurrentTechnique already initialized in action<technique_name>
-			}
-			else if (s.Depth == 2) // enters pass
-			{
-				s.CurrentPass = sTechniquePass();
-			}
+			s.CurrentTechnique = sTechnique();
+			s.CurrentTechnique.Name = matched(in);
 		}
 	};
 
 	template<>
-	struct technique_action<one<'}'>>
+	struct effect_action<technique_end>
 	{
 		template<typename Input>
-		static void apply(const Input& /* in */, technique_state& s)
+		static void apply(const Input& /* in */, effect_state& s)
 		{
-			s.Depth--;
+			s.Techniques.push_back(std::move(s.CurrentTechnique));
+		}
+	};
 
-			if (s.Depth == 0) // exits technique
-			{
-				s.Techniques.push_back(s.CurrentTechnique);
-			}
-			else if (s.Depth == 1) // exits pass
-			{
-				s.CurrentTechnique.Passes.push_back(s.CurrentPass);
-			}
+	template<>
+	struct effect_action<pass_begin>
+	{
+		template<typename Input>
+		static void apply(const Input& /* in */, effect_state& s)
+		{
+			s.CurrentPass = sTechniquePass();
 		}
 	};
 
 	template<>
-	struct technique_action<technique_name>
+	struct effect_action<pass_end>
 	{
 		template<typename Input>
-		static void apply(const Input& in, technique_state& s)
+		static void apply(const Input& /* in */, effect_state& s)
 		{
-			s.CurrentTechnique = sTechnique();
-			s.CurrentTechnique.Name = in.string();
+			s.CurrentTechnique.Passes.push_back(std::move(s.CurrentPass));
 		}
 	};
 
 	template<>
-	struct technique_action<assignment_name>
+	struct effect_action<pass_assignment_name>
 	{
 		template<typename Input>
-		static void apply(const Input& in, technique_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.CurrentAssignment = technique_state::sRawAssignment();
-			s.CurrentAssignment.Type = in.string();
+			s.CurrentAssignment = effect_state::sRawAssignment();
+			s.CurrentAssignment.Type = matched(in);
 		}
 	};
 
 	template<>
-	struct technique_action<assignment_value>
+	struct effect_action<pass_assignment_value>
 	{
+		static uint16_t GetProgramId(effect_state& s, int type, std::string_view name)
+		{
+			if (name == CEffect::NullProgramName)
+			{
+				return 0;
+			}
+
+			auto e = s.ProgramIds[type].find(name);
+			if (e != s.ProgramIds[type].end())
+			{
+				return e->second;
+			}
+
+			std::vector<std::string_view>& programs = s.Programs[type];
+			if (programs.size() >= std::numeric_limits<uint16_t>::max())
+			{
+				throw std::length_error("Number of programs exceeds " + std::to_string(std::numeric_limits<uint16_t>::max()));
+			}
+
+			programs.push_back(name);
+			const uint16_t id = static_cast<uint16_t>(programs.size());
+			s.ProgramIds[type].emplace(name, id);
+			return id;
+		}
+
 		template<typename Input>
-		static void apply(const Input& in, technique_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.CurrentAssignment.Value = in.string();
+			s.CurrentAssignment.Value = matched(in);
 
 			bool isShaderAssignment = false;
 			for (int i = 0; i < static_cast<int>(eProgramType::NumberOfTypes); i++)
@@ -154,7 +281,7 @@ namespace hlsl_grammar
 				eProgramType type = static_cast<eProgramType>(i);
 				if (s.CurrentAssignment.Type == CEffect::GetAssignmentTypeForProgram(type))
 				{
-					s.CurrentPass.Shaders[i] = s.CurrentAssignment.Value;
+					s.CurrentPass.Programs[i] = GetProgramId(s, i, s.CurrentAssignment.Value);
 					isShaderAssignment = true;
 					break;
 				}
@@ -167,144 +294,67 @@ namespace hlsl_grammar
 		}
 	};
 
-
-	struct shared_variable_storage_class : str_shared {};
-	struct shared_variable_type_modifier : sor<
-		str_const, str_row_major, str_column_major
-	> {};
-	struct shared_variable_type : identifier {};
-	struct shared_variable_name : identifier {};
-	struct shared_variable : seq<
-		shared_variable_storage_class, sp_p,
-		opt<shared_variable_type_modifier>, sp_s,
-		shared_variable_type, sp_s,
-		shared_variable_name, sp_s
-	> {};
-
-	struct shared_variable_grammar : star<until<shared_variable>> {};
-
-	struct shared_variable_state
-	{
-		std::vector<std::string> Names;
-	};
-
-	template<typename Rule>
-	struct shared_variable_action {};
-
 	template<>
-	struct shared_variable_action<shared_variable_name>
+	struct effect_action<shared_variable_name>
 	{
 		template<typename Input>
-		static void apply(const Input& in, shared_variable_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.Names.push_back(in.string());
+			s.SharedVariables.push_back(matched(in));
 		}
 	};
 
-
-	struct sampler_type : sor<
-		str_sampler, str_sampler1D, str_sampler2D,
-		str_sampler3D, str_samplerCUBE, str_SamplerState
-	> {};
-	struct sampler_name : identifier {};
-	struct sampler_register : seq<
-		one<':'>, sp_s,
-		str_register, sp_s,
-		parens<
-			seq<alpha, integer_dec>
-		>, sp_s
-	> {};
-	struct sampler_assignments : seq<
-		braces<star<assignment>>
-	> {};
-	struct sampler : seq<
-		sampler_type, sp_s,
-		sampler_name, sp_s,
-		star<sampler_register>, sp_s,
-		opt<sampler_assignments>, sp_s,
-		one<';'>
-	> {};
-
-	struct sampler_grammar : star<until<sampler>> {};
-
-	struct sampler_state
-	{
-		struct sRawAssignment
-		{
-			std::string Type;
-			std::string Value;
-		};
-
-		int Depth = 0;
-		sSamplerState CurrentSampler;
-		sRawAssignment CurrentAssignment;
-		std::vector<sSamplerState> Samplers;
-	};
-
-	template<typename Rule>
-	struct sampler_action {};
-
 	template<>
-	struct sampler_action<one<'{'>>
+	struct effect_action<shared_sampler>
 	{
 		template<typename Input>
-		static void apply(const Input& /* in */, sampler_state& s)
+		static void apply(const Input& /* in */, effect_state& s)
 		{
-			s.Depth++;
-
-			if (s.Depth == 1) // enters sampler state assignments
-			{
-				// nothing to do
-			}
+			s.SharedVariables.push_back(s.CurrentSampler.Name);
 		}
 	};
 
 	template<>
-	struct sampler_action<one<'}'>>
+	struct effect_action<sampler_name>
 	{
 		template<typename Input>
-		static void apply(const Input& /* in */, sampler_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.Depth--;
-
-			if (s.Depth == 0) // exits sampler state assignments
-			{
-				s.Samplers.push_back(s.CurrentSampler);
-			}
+			s.CurrentSampler = sSamplerState();
+			s.CurrentSampler.Name = matched(in);
 		}
 	};
 
 	template<>
-	struct sampler_action<sampler_name>
+	struct effect_action<sampler_end>
 	{
 		template<typename Input>
-		static void apply(const Input& in, sampler_state& s)
+		static void apply(const Input& /* in */, effect_state& s)
 		{
-			s.CurrentSampler = sSamplerState();
-			s.CurrentSampler.Name = in.string();
+			s.Samplers.push_back(std::move(s.CurrentSampler));
 		}
 	};
 
 	template<>
-	struct sampler_action<assignment_name>
+	struct effect_action<sampler_assignment_name>
 	{
 		template<typename Input>
-		static void apply(const Input& in, sampler_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.CurrentAssignment = sampler_state::sRawAssignment();
-			s.CurrentAssignment.Type = in.string();
+			s.CurrentAssignment = effect_state::sRawAssignment();
+			s.CurrentAssignment.Type = matched(in);
 		}
 	};
 
 	template<>
-	struct sampler_action<assignment_value>
+	struct effect_action<sampler_assignment_value>
 	{
 		template<typename Input>
-		static void apply(const Input& in, sampler_state& s)
+		static void apply(const Input& in, effect_state& s)
 		{
-			s.CurrentAssignment.Value = in.string();
+			s.CurrentAssignment.Value = matched(in);
 
 			s.CurrentSampler.Assignments.push_back(sAssignment::GetSamplerStateAssignment(s.CurrentAssignment.Type, s.CurrentAssignment.Value));
 		}
 	};
-} // namespace hlsl_grammar
\ No newline at end of file
+} // namespace hlsl_grammar
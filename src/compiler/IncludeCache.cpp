@@ -0,0 +1,153 @@
+#include "IncludeCache.h"
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+CIncludeCache::CIncludeCache(bool mapFiles, bool checkForChanges)
+	: mMapFiles(mapFiles), mCheckForChanges(checkForChanges), mFilesRead(0), mBytesRead(0), mOpens(0), mBytesOpened(0), mPathLookups(0), mPathLookupHits(0)
+{
+}
+
+std::shared_ptr<const sIncludeFile> CIncludeCache::Open(const fs::path& filePath)
+{
+	std::shared_ptr<const sIncludeFile> file;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto e = mFiles.find(filePath.native());
+		if (e != mFiles.end())
+		{
+			file = e->second;
+		}
+	}
+
+	bool modified = false;
+	if (file && mCheckForChanges)
+	{
+		std::error_code ec;
+		const fs::file_time_type lastWriteTime = fs::last_write_time(filePath, ec);
+		const uintmax_t size = fs::file_size(filePath, ec);
+		modified = ec || lastWriteTime != file->LastWriteTime || size != file->Size;
+	}
+
+	if (!file || modified)
+	{
+		// read the file without holding the lock, if another thread reads the same file at the same
+		// time the first one inserted is kept
+		auto f = std::make_shared<sIncludeFile>();
+		f->Path = filePath;
+
+		std::error_code ec;
+		f->LastWriteTime = fs::last_write_time(filePath, ec);
+
+		if (!mMapFiles)
+		{
+			std::ifstream stream(filePath, std::ios::binary | std::ios::in | std::ios::ate);
+			if (!stream)
+			{
+				return nullptr;
+			}
+
+			const std::streamoff size = stream.tellg();
+			stream.seekg(0);
+			f->Buffer.resize(size > 0 ? static_cast<size_t>(size) : 1);
+			if (size > 0 && !stream.read(f->Buffer.data(), size))
+			{
+				return nullptr;
+			}
+
+			f->Data = f->Buffer.data();
+			f->Size = static_cast<size_t>(size);
+		}
+		else
+		{
+			try
+			{
+				f->Mapping = std::make_unique<CMappedFile>(filePath);
+			}
+			catch (const std::runtime_error&)
+			{
+				return nullptr;
+			}
+
+			if (f->Mapping->Size() > 0)
+			{
+				f->Data = reinterpret_cast<const char*>(f->Mapping->Data());
+				f->Size = f->Mapping->Size();
+			}
+			else
+			{
+				f->Buffer.resize(1);
+				f->Data = f->Buffer.data();
+				f->Size = 0;
+			}
+		}
+
+		mFilesRead++;
+		mBytesRead += f->Size;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (modified)
+		{
+			mFiles[filePath.native()] = f;
+			file = std::move(f);
+		}
+		else
+		{
+			file = mFiles.try_emplace(filePath.native(), std::move(f)).first->second;
+		}
+	}
+
+	mOpens++;
+	mBytesOpened += file->Size;
+	return file;
+}
+
+fs::path CIncludeCache::Resolve(const fs::path& directory, std::string_view fileName)
+{
+	fs::path::string_type key = directory.native();
+	key += fs::path::preferred_separator;
+	key += fs::path(fileName).native();
+
+	mPathLookups++;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto e = mResolvedPaths.find(key);
+		if (e != mResolvedPaths.end())
+		{
+			mPathLookupHits++;
+			return e->second;
+		}
+	}
+
+	std::error_code ec;
+	fs::path filePath = fs::weakly_canonical(directory / fileName, ec);
+	if (ec || !fs::is_regular_file(filePath, ec))
+	{
+		filePath.clear();
+	}
+
+	if (filePath.empty() && mCheckForChanges)
+	{
+		// the file may be created later
+		return filePath;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mResolvedPaths.try_emplace(std::move(key), std::move(filePath)).first->second;
+}
+
+void CIncludeCache::Invalidate(const std::vector<fs::path>& filePaths)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (const auto& p : filePaths)
+	{
+		mFiles.erase(p.native());
+	}
+	mResolvedPaths.clear();
+}
+
+sIncludeCacheStats CIncludeCache::Stats() const
+{
+	return { mFilesRead, mBytesRead, mOpens, mBytesOpened, mPathLookups, mPathLookupHits };
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "MappedFile.h"
+
+struct sIncludeFile
+{
+	std::filesystem::path Path;
+	const char* Data = nullptr;
+	size_t Size = 0;
+	std::filesystem::file_time_type LastWriteTime;
+
+	std::unique_ptr<CMappedFile> Mapping;	// owns Data when the file is mapped
+	std::vector<char> Buffer;				// owns Data when the file is not mapped or is empty, so each file still has a unique Data pointer
+};
+
+struct sIncludeCacheStats
+{
+	uint32_t FilesRead;			// files read from disk
+	uint64_t BytesRead;			// bytes read from disk
+	uint32_t Opens;				// files handed out to the compiler
+	uint64_t BytesOpened;		// bytes handed out to the compiler, what would have been read without the cache
+	uint32_t PathLookups;		// include paths resolved
+	uint32_t PathLookupHits;	// include paths resolved without touching the file system
+};
+
+// Immutable, memory-mapped contents of the include files and the results of resolving include
+// paths, shared by every effect compiled in the process
+class CIncludeCache
+{
+private:
+	bool mMapFiles;
+	bool mCheckForChanges;
+	std::mutex mMutex;
+	std::unordered_map<std::filesystem::path::string_type, std::shared_ptr<const sIncludeFile>> mFiles;
+	std::unordered_map<std::filesystem::path::string_type, std::filesystem::path> mResolvedPaths;
+
+	std::atomic<uint32_t> mFilesRead;
+	std::atomic<uint64_t> mBytesRead;
+	std::atomic<uint32_t> mOpens;
+	std::atomic<uint64_t> mBytesOpened;
+	std::atomic<uint32_t> mPathLookups;
+	std::atomic<uint32_t> mPathLookupHits;
+
+public:
+	// mapFiles: if false, the files are copied to memory instead, needed if they may be modified
+	// while cached since Windows doesn't allow truncating a mapped file
+	// checkForChanges: if true, cached files are read again when their size or last write time
+	// changes and failed path lookups are not cached, for long running processes
+	CIncludeCache(bool mapFiles = true, bool checkForChanges = false);
+	CIncludeCache(const CIncludeCache&) = delete;
+	CIncludeCache& operator=(const CIncludeCache&) = delete;
+
+	// filePath: canonical path of the file, as returned by Resolve
+	std::shared_ptr<const sIncludeFile> Open(const std::filesystem::path& filePath);
+	// Returns the canonical path of `directory / fileName` or an empty path if it is not a regular
+	// file. Failed lookups are cached too.
+	std::filesystem::path Resolve(const std::filesystem::path& directory, std::string_view fileName);
+	// Removes the files from the cache, so they are read again the next time they are opened. Files
+	// already opened stay valid. Resolved paths are cleared too, since files may have been created or removed.
+	void Invalidate(const std::vector<std::filesystem::path>& filePaths);
+
+	sIncludeCacheStats Stats() const;
+};
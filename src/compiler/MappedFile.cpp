@@ -0,0 +1,116 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#ifdef _WIN32
+
+CMappedFile::CMappedFile(const fs::path& filePath)
+	: mData(nullptr), mSize(0), mFileHandle(INVALID_HANDLE_VALUE), mMappingHandle(nullptr)
+{
+	mFileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFileHandle == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Failed to open file '" + filePath.string() + "'");
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFileHandle, &size))
+	{
+		CloseHandle(mFileHandle);
+		throw std::runtime_error("Failed to get size of file '" + filePath.string() + "'");
+	}
+
+	mSize = static_cast<size_t>(size.QuadPart);
+	if (mSize == 0)
+	{
+		return; // empty files cannot be mapped
+	}
+
+	mMappingHandle = CreateFileMappingW(mFileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMappingHandle)
+	{
+		mData = static_cast<const uint8_t*>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+	}
+
+	if (!mData)
+	{
+		if (mMappingHandle)
+		{
+			CloseHandle(mMappingHandle);
+		}
+		CloseHandle(mFileHandle);
+		throw std::runtime_error("Failed to map file '" + filePath.string() + "'");
+	}
+}
+
+CMappedFile::~CMappedFile()
+{
+	if (mData)
+	{
+		UnmapViewOfFile(mData);
+	}
+
+	if (mMappingHandle)
+	{
+		CloseHandle(mMappingHandle);
+	}
+
+	if (mFileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mFileHandle);
+	}
+}
+
+#else
+
+CMappedFile::CMappedFile(const fs::path& filePath)
+	: mData(nullptr), mSize(0)
+{
+	const int fd = open(filePath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("Failed to open file '" + filePath.string() + "'");
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("Failed to get size of file '" + filePath.string() + "'");
+	}
+
+	mSize = static_cast<size_t>(st.st_size);
+	if (mSize > 0)
+	{
+		void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("Failed to map file '" + filePath.string() + "'");
+		}
+
+		mData = static_cast<const uint8_t*>(data);
+	}
+
+	// the mapping stays valid after closing the descriptor
+	close(fd);
+}
+
+CMappedFile::~CMappedFile()
+{
+	if (mData)
+	{
+		munmap(const_cast<uint8_t*>(mData), mSize);
+	}
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <filesystem>
+
+// Read-only view of a whole file mapped in memory
+class CMappedFile
+{
+private:
+	const uint8_t* mData;
+	size_t mSize;
+#ifdef _WIN32
+	void* mFileHandle;
+	void* mMappingHandle;
+#endif
+
+public:
+	CMappedFile(const std::filesystem::path& filePath);
+	~CMappedFile();
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	// nullptr for empty files
+	inline const uint8_t* Data() const { return mData; }
+	inline size_t Size() const { return mSize; }
+};
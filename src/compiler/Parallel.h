@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs used when the user doesn't specify one
+inline uint32_t DefaultNumberOfJobs()
+{
+	const uint32_t n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+// Calls fn(i) for each i in [0, count) using up to numJobs threads, including the calling thread.
+// If any call throws, no more indices are started and the exception thrown by the lowest index is
+// rethrown once all threads finish, so the error reported is the same one a serial loop would report.
+template<typename Fn>
+void ParallelFor(size_t count, uint32_t numJobs, Fn&& fn)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	const size_t numThreads = std::min<size_t>(count, numJobs > 0 ? numJobs : 1);
+	if (numThreads == 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			fn(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> nextIndex = 0;
+	std::atomic<bool> failed = false;
+	std::mutex errorMutex;
+	size_t errorIndex = count;
+	std::exception_ptr error;
+
+	auto worker = [&]()
+	{
+		while (!failed.load(std::memory_order_relaxed))
+		{
+			const size_t i = nextIndex.fetch_add(1);
+			if (i >= count)
+			{
+				break;
+			}
+
+			try
+			{
+				fn(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (i < errorIndex)
+				{
+					errorIndex = i;
+					error = std::current_exception();
+				}
+				failed = true;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (size_t i = 0; i < numThreads - 1; i++)
+	{
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
@@ -0,0 +1,174 @@
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct sTraceEvent
+	{
+		std::string_view Category;
+		std::string Name;
+		std::string Detail;
+		uint64_t Start;
+		uint64_t Duration;
+		uint32_t ThreadId;
+	};
+
+	std::atomic<bool> gEnabled = false;
+	std::chrono::steady_clock::time_point gStartTime;
+	std::mutex gEventsMutex;
+	std::vector<sTraceEvent> gEvents;
+
+	uint32_t GetThreadId()
+	{
+		static std::atomic<uint32_t> nextId = 1;
+		thread_local const uint32_t id = nextId++;
+		return id;
+	}
+
+	void WriteJsonString(std::ostream& out, std::string_view str)
+	{
+		out << '"';
+		for (char c : str)
+		{
+			switch (c)
+			{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+				{
+					out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+				}
+				else
+				{
+					out << c;
+				}
+				break;
+			}
+		}
+		out << '"';
+	}
+}
+
+void CTrace::Enable()
+{
+	gStartTime = std::chrono::steady_clock::now();
+	gEnabled = true;
+}
+
+bool CTrace::IsEnabled()
+{
+	return gEnabled.load(std::memory_order_relaxed);
+}
+
+void CTrace::Record(std::string_view category, std::string_view name, std::string_view detail, uint64_t start, uint64_t duration)
+{
+	sTraceEvent e{ category, std::string(name), std::string(detail), start, duration, GetThreadId() };
+
+	std::lock_guard<std::mutex> lock(gEventsMutex);
+	gEvents.push_back(std::move(e));
+}
+
+uint64_t CTrace::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - gStartTime).count();
+}
+
+void CTrace::WriteChromeTrace(std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock(gEventsMutex);
+
+	out << "{\"traceEvents\":[";
+	for (size_t i = 0; i < gEvents.size(); i++)
+	{
+		const sTraceEvent& e = gEvents[i];
+		out << (i == 0 ? "\n" : ",\n") << "{\"name\":";
+		WriteJsonString(out, e.Name);
+		out << ",\"cat\":";
+		WriteJsonString(out, e.Category);
+		out << ",\"ph\":\"X\",\"ts\":" << e.Start << ",\"dur\":" << e.Duration << ",\"pid\":1,\"tid\":" << e.ThreadId;
+		if (!e.Detail.empty())
+		{
+			out << ",\"args\":{\"detail\":";
+			WriteJsonString(out, e.Detail);
+			out << "}";
+		}
+		out << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void CTrace::WriteSummary(std::ostream& out)
+{
+	struct sCategoryStats
+	{
+		size_t Count = 0;
+		uint64_t Total = 0;
+		const sTraceEvent* Slowest = nullptr;
+	};
+
+	std::lock_guard<std::mutex> lock(gEventsMutex);
+
+	std::map<std::string_view, sCategoryStats> categories;
+	for (const auto& e : gEvents)
+	{
+		sCategoryStats& s = categories[e.Category];
+		s.Count++;
+		s.Total += e.Duration;
+		if (!s.Slowest || e.Duration > s.Slowest->Duration)
+		{
+			s.Slowest = &e;
+		}
+	}
+
+	const std::ios_base::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+
+	// the time of the categories that contain other categories (e.g. "effect") is not exclusive,
+	// so there is no grand total
+	out << std::left << std::setw(12) << "phase" << std::right << std::setw(8) << "count"
+		<< std::setw(12) << "total ms" << std::setw(12) << "max ms" << "  slowest" << std::endl;
+	for (const auto& [category, s] : categories)
+	{
+		out << std::left << std::setw(12) << category << std::right << std::setw(8) << s.Count
+			<< std::fixed << std::setprecision(2)
+			<< std::setw(12) << s.Total / 1000.0 << std::setw(12) << s.Slowest->Duration / 1000.0
+			<< "  " << s.Slowest->Name;
+		if (!s.Slowest->Detail.empty())
+		{
+			out << " (" << s.Slowest->Detail << ")";
+		}
+		out << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+CTraceScope::CTraceScope(std::string_view category, std::string_view name, std::string_view detail)
+	: mCategory(category), mStart(0), mEnabled(CTrace::IsEnabled())
+{
+	if (mEnabled)
+	{
+		mName = name;
+		mDetail = detail;
+		mStart = CTrace::Now();
+	}
+}
+
+CTraceScope::~CTraceScope()
+{
+	if (mEnabled)
+	{
+		CTrace::Record(mCategory, mName, mDetail, mStart, CTrace::Now() - mStart);
+	}
+}
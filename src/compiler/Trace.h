@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Records how long each phase of the compilation takes. Nothing is recorded until Enable is called.
+class CTrace
+{
+public:
+	static void Enable();
+	static bool IsEnabled();
+
+	// start: microseconds since the trace was enabled
+	static void Record(std::string_view category, std::string_view name, std::string_view detail, uint64_t start, uint64_t duration);
+	static uint64_t Now();
+
+	// Writes the events in the Chrome trace event format, for chrome://tracing or Perfetto
+	static void WriteChromeTrace(std::ostream& out);
+	// Writes the total time spent in each category
+	static void WriteSummary(std::ostream& out);
+};
+
+// Records the time spent in the scope
+class CTraceScope
+{
+private:
+	std::string_view mCategory;
+	std::string mName;
+	std::string mDetail;
+	uint64_t mStart;
+	bool mEnabled;
+
+public:
+	// category: must outlive the trace, phases are grouped by it in the summary
+	CTraceScope(std::string_view category, std::string_view name, std::string_view detail = {});
+	~CTraceScope();
+	CTraceScope(const CTraceScope&) = delete;
+	CTraceScope& operator=(const CTraceScope&) = delete;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <string_view>
+
+// Matches `*` (any sequence) and `?` (any character) wildcards
+inline bool MatchesWildcard(std::string_view pattern, std::string_view str)
+{
+	size_t p = 0, s = 0;
+	size_t starP = std::string_view::npos, starS = 0;
+	while (s < str.size())
+	{
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s]))
+		{
+			p++;
+			s++;
+		}
+		else if (p < pattern.size() && pattern[p] == '*')
+		{
+			starP = p++;
+			starS = s;
+		}
+		else if (starP != std::string_view::npos)
+		{
+			// backtrack, let the last `*` consume one more character
+			p = starP + 1;
+			s = ++starS;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (p < pattern.size() && pattern[p] == '*')
+	{
+		p++;
+	}
+
+	return p == pattern.size();
+}
@@ -3,10 +3,16 @@
 #include <memory>
 #include <filesystem>
 #include <fstream>
-#include <sstream>
 #include <tclap/CmdLine.h>
-#include "Effect.h"
-#include "EffectSaver.h"
+#include "EffectCompiler.h"
+#include "Parallel.h"
+#include "CodeCache.h"
+#include "CompileServer.h"
+#include "Trace.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -15,64 +21,211 @@ int main(int argc, char** argv)
 	try
 	{
 		TCLAP::CmdLine cmd("Shader effect compiler for Grand Theft Auto V", ' ', "WIP");
-		TCLAP::UnlabeledValueArg<std::filesystem::path> inputArg("input_file", "Specifies the filename of the input file.", true, "", "input_file");
-		TCLAP::ValueArg<std::filesystem::path> outputArg("o", "output", "Specifies the filename of the output file.", false, "", "file");
+		TCLAP::UnlabeledValueArg<std::filesystem::path> inputArg("input_file", "Specifies the filename of the input file. In batch mode, a directory, a glob pattern, a single .fx file or a manifest file listing the input files. Required unless running as a server.", false, "", "input_file");
+		TCLAP::ValueArg<std::filesystem::path> outputArg("o", "output", "Specifies the filename of the output file. In batch mode, the directory of the output files.", false, "", "file");
+		TCLAP::SwitchArg batchArg("b", "batch", "Compiles multiple effects in a single process. Errors in one effect don't stop the remaining effects.", false);
 		TCLAP::MultiArg<std::filesystem::path> includeDirsArg("i", "include_directories", "Specifies additional include directories.", false, "directory");
+		TCLAP::MultiArg<std::string> definesArg("D", "define", "Defines a macro, as NAME or NAME=VALUE.", false, "macro");
+		TCLAP::MultiArg<std::string> techniquesArg("t", "technique", "Only compiles the techniques whose name matches the pattern, which may contain '*' and '?' wildcards, and the programs they use. Can be repeated. Meant for development builds, the other techniques are missing from the output. Effects with techniques but none matching fail to compile.", false, "pattern");
+		TCLAP::ValueArg<std::filesystem::path> permutationsArg("", "permutations", "Compiles a variant of each effect for every combination of defines of a define matrix file. Each line is an axis with its alternatives separated by '|', each alternative with zero or more defines separated by spaces. The output files are named after the defines of each variant. Variants with the same preprocessed source are only compiled once.", false, "", "file");
 		TCLAP::SwitchArg preprocessArg("p", "preprocess", "Preprocesses the input file instead of compiling it.", false);
+		TCLAP::SwitchArg validateArg("", "validate", "Only parses the techniques, sampler states and shared variables of the input file, without compiling it.", false);
+		TCLAP::ValueArg<std::filesystem::path> cacheDirArg("", "cache_dir", "Specifies the directory of the compiled programs cache. The cache is disabled if not set.", false, "", "directory");
+		TCLAP::ValueArg<uint32_t> cacheSizeArg("", "cache_size", "Specifies the maximum size of the compiled programs cache, in megabytes. 0 for no limit.", false, 1024, "megabytes");
+		TCLAP::SwitchArg statsArg("s", "stats", "Prints cache and include files statistics after compiling.", false);
+		TCLAP::ValueArg<std::filesystem::path> duplicatesReportArg("", "duplicates_report", "Writes the programs of all the compiled effects that have identical bytecode to a file, with the bytes that are duplicated.", false, "", "file");
+		TCLAP::SwitchArg depfileArg("d", "depfile", "Writes a Makefile/Ninja depfile next to each output file, named after the output file with a '.d' suffix.", false);
+		TCLAP::SwitchArg skipUpToDateArg("u", "skip_up_to_date", "Skips the effects whose output is newer than the input and every file included by it, as recorded in the depfile. Use with --depfile.", false);
+		TCLAP::SwitchArg watchArg("w", "watch", "Keeps running after compiling and compiles the effects again when the input file or any file included by it changes. Compiled programs are kept in memory between compilations.", false);
+		TCLAP::ValueArg<std::string> serverArg("", "server", "Runs as a compile server, reading requests from the standard input if 'stdio', or else from the Unix domain socket at the given path. See CompileServer.h for the protocol.", false, "", "stdio|socket");
+		TCLAP::SwitchArg timingsArg("", "timings", "Prints the time spent in each phase of the compilation. Not supported with --watch or --server.", false);
+		TCLAP::ValueArg<std::filesystem::path> traceArg("", "trace", "Writes the time spent in each phase of the compilation to a file in the Chrome trace event format. Not supported with --watch or --server.", false, "", "file");
+		TCLAP::ValueArg<uint32_t> jobsArg("j", "jobs", "Specifies the number of programs or effects to compile in parallel. Defaults to the number of hardware threads.", false, 0, "count");
 
 		cmd.add(inputArg);
 		cmd.add(outputArg);
+		cmd.add(batchArg);
 		cmd.add(includeDirsArg);
+		cmd.add(definesArg);
+		cmd.add(techniquesArg);
+		cmd.add(permutationsArg);
 		cmd.add(preprocessArg);
+		cmd.add(validateArg);
+		cmd.add(jobsArg);
+		cmd.add(cacheDirArg);
+		cmd.add(cacheSizeArg);
+		cmd.add(statsArg);
+		cmd.add(duplicatesReportArg);
+		cmd.add(depfileArg);
+		cmd.add(skipUpToDateArg);
+		cmd.add(watchArg);
+		cmd.add(serverArg);
+		cmd.add(timingsArg);
+		cmd.add(traceArg);
 
 		cmd.parse(argc, argv);
 
-		fs::path inputPath = fs::absolute(inputArg.getValue());
+		const bool watch = watchArg.getValue();
+		// the variants are compiled as a batch, even with a single input file
+		const bool batch = batchArg.getValue() || permutationsArg.isSet();
 
-		if (!fs::exists(inputPath))
+		if (timingsArg.getValue() || traceArg.isSet())
 		{
-			throw std::runtime_error("Path '" + inputPath.string() + "' does not exist");
+			// the trace is only written on exit, it would grow without limit in the modes that keep running
+			if (watch || serverArg.isSet())
+			{
+				throw std::invalid_argument("--timings and --trace can't be used with --watch or --server");
+			}
+
+			CTrace::Enable();
+		}
+
+		std::unique_ptr<CCodeCache> cache;
+		if (cacheDirArg.isSet() || watch)
+		{
+			// in watch mode, the programs are always kept in memory, even without a cache directory
+			cache = std::make_unique<CCodeCache>(cacheDirArg.getValue(), static_cast<uint64_t>(cacheSizeArg.getValue()) * 1024 * 1024, watch);
 		}
 
-		if (!fs::is_regular_file(inputPath))
+		sCompilerOptions options;
+		options.Mode = preprocessArg.getValue() ? eCompileMode::Preprocess :
+					   validateArg.getValue() ? eCompileMode::Validate :
+					   eCompileMode::Compile;
+		options.IncludeDirectories = includeDirsArg.getValue();
+		for (const auto& d : definesArg.getValue())
 		{
-			throw std::runtime_error("Path '" + inputPath.string() + "' does not refer to a file");
+			options.Defines.push_back(CEffectCompiler::ParseDefine(d));
 		}
+		options.Techniques = techniquesArg.getValue();
+		options.NumJobs = jobsArg.isSet() && jobsArg.getValue() > 0 ? jobsArg.getValue() : DefaultNumberOfJobs();
+		options.Cache = cache.get();
+		options.WriteDepfile = depfileArg.getValue();
+		options.SkipUpToDate = skipUpToDateArg.getValue();
+		options.MapIncludeFiles = !watch; // otherwise the include files couldn't be saved while they are mapped
+		options.RecordDuplicatePrograms = duplicatesReportArg.isSet();
 
-		fs::path outputPath = inputPath;
-		if (outputArg.isSet())
+		if (serverArg.isSet())
 		{
-			outputPath = fs::absolute(outputArg.getValue());
+			CCompileServer server(options.NumJobs, cache.get());
+			if (serverArg.getValue() == "stdio")
+			{
+#ifdef _WIN32
+				// the responses contain binary data
+				_setmode(_fileno(stdin), _O_BINARY);
+				_setmode(_fileno(stdout), _O_BINARY);
+#endif
+				server.Serve(std::cin, std::cout);
+				if (cache)
+				{
+					cache->Trim();
+				}
+				return EXIT_SUCCESS;
+			}
+			else
+			{
+				server.Listen(serverArg.getValue());
+			}
 		}
-		else if (preprocessArg.getValue())
+
+		if (!inputArg.isSet())
+		{
+			throw std::invalid_argument("Missing input file");
+		}
+
+		CEffectCompiler compiler(options);
+
+		std::vector<sCompileJob> jobs;
+		if (batchArg.getValue())
 		{
-			outputPath.replace_filename("preprocessed." + outputPath.filename().string());
+			fs::path outputDir;
+			if (outputArg.isSet())
+			{
+				outputDir = fs::absolute(outputArg.getValue());
+				fs::create_directories(outputDir);
+			}
+
+			for (const auto& p : CEffectCompiler::FindBatchInputs(inputArg.getValue()))
+			{
+				jobs.push_back({ p, CEffectCompiler::GetDefaultOutputPath(p, options.Mode, outputDir) });
+			}
 		}
 		else
 		{
-			outputPath.replace_extension("fxc");
+			sCompileJob job;
+			job.InputPath = fs::absolute(inputArg.getValue());
+			job.OutputPath = outputArg.isSet() ?
+							 fs::absolute(outputArg.getValue()) :
+							 CEffectCompiler::GetDefaultOutputPath(job.InputPath, options.Mode);
+			jobs.push_back(job);
 		}
 
-		std::ifstream inputFile(inputPath);
-		std::stringstream srcBuffer;
-		srcBuffer << inputFile.rdbuf();
+		if (permutationsArg.isSet())
+		{
+			jobs = CEffectCompiler::ExpandVariants(jobs, CEffectCompiler::ParsePermutations(permutationsArg.getValue()));
+		}
 
-		std::string src = srcBuffer.str();
-		const auto& includeDirs = includeDirsArg.getValue();		
-		std::unique_ptr<CEffect> fx = std::make_unique<CEffect>(src, inputPath, includeDirs);
+		if (watch)
+		{
+			compiler.Watch(jobs, std::cerr);
+		}
 
-		if (preprocessArg.getValue())
+		size_t numFailed = 0;
+		if (batch)
 		{
-			std::ofstream outputStream(outputPath, std::ios::trunc);
-			outputStream << fx->PreprocessSource();
+			numFailed = compiler.CompileBatch(jobs, std::cerr);
+			std::cout << (jobs.size() - numFailed) << " of " << jobs.size() << " effects processed successfully" << std::endl;
 		}
 		else
 		{
-			CEffectSaver saver(*fx);
-			saver.SaveTo(outputPath);
+			const sCompileJob& job = jobs[0];
+			if (!compiler.Compile(job, options.NumJobs))
+			{
+				std::cout << "'" << job.OutputPath.string() << "' is up to date" << std::endl;
+			}
+		}
+
+		if (cache)
+		{
+			cache->Trim();
+
+			if (statsArg.getValue())
+			{
+				std::cout << "Cache '" << (cache->Directory().empty() ? "<memory>" : cache->Directory().string()) << "': "
+						  << cache->Hits() << " hits, " << cache->Misses() << " misses, " << cache->Inserts() << " inserts" << std::endl;
+			}
+		}
+
+		if (timingsArg.getValue())
+		{
+			CTrace::WriteSummary(std::cout);
+		}
+
+		if (traceArg.isSet())
+		{
+			std::ofstream traceFile(traceArg.getValue(), std::ios::trunc);
+			CTrace::WriteChromeTrace(traceFile);
+		}
+
+		if (statsArg.getValue())
+		{
+			const sIncludeCacheStats s = compiler.IncludeCache().Stats();
+			std::cout << "Includes: " << s.FilesRead << " files read (" << s.BytesRead << " bytes), "
+					  << s.Opens << " files opened (" << s.BytesOpened << " bytes), "
+					  << s.PathLookupHits << " of " << s.PathLookups << " path lookups cached" << std::endl;
+
+			const sCodeInternerStats p = compiler.CodeInterner().Stats();
+			std::cout << "Programs: " << p.Programs << " programs (" << p.Bytes << " bytes), "
+					  << p.UniquePrograms << " with different bytecode (" << p.UniqueBytes << " bytes), "
+					  << p.CompileHits << " compilations shared" << std::endl;
+		}
+
+		if (duplicatesReportArg.isSet())
+		{
+			std::ofstream reportFile(duplicatesReportArg.getValue(), std::ios::trunc);
+			compiler.CodeInterner().WriteDuplicatesReport(reportFile);
 		}
 
-		return EXIT_SUCCESS;
+		return numFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 	catch(const std::exception& e)
 	{
@@ -0,0 +1,346 @@
+#ifdef _WIN32
+// must be included before windows.h, which is included by the D3D headers
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CodeCache.h"
+#include "CompileServer.h"
+#include "Effect.h"
+#include "EffectParser.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+#ifdef _WIN32
+	using tSocket = SOCKET;
+	constexpr tSocket InvalidSocket = INVALID_SOCKET;
+	constexpr int ShutdownSend = SD_SEND;
+	void CloseSocket(tSocket s) { closesocket(s); }
+#else
+	using tSocket = int;
+	constexpr tSocket InvalidSocket = -1;
+	constexpr int ShutdownSend = SHUT_WR;
+	void CloseSocket(tSocket s) { close(s); }
+#endif
+
+	void Check(bool condition, const std::string& message)
+	{
+		if (!condition)
+		{
+			throw std::runtime_error(message);
+		}
+	}
+
+	// Connects to the server listening on `socketPath`, waiting for it to start listening
+	tSocket Connect(const fs::path& socketPath)
+	{
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		const std::string pathStr = socketPath.string();
+		pathStr.copy(address.sun_path, sizeof(address.sun_path) - 1);
+
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (true)
+		{
+			const tSocket s = socket(AF_UNIX, SOCK_STREAM, 0);
+			Check(s != InvalidSocket, "Failed to create socket");
+			if (connect(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0)
+			{
+				return s;
+			}
+
+			CloseSocket(s);
+			Check(std::chrono::steady_clock::now() < deadline, "Failed to connect to '" + pathStr + "'");
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	void SendAll(tSocket s, const std::string& data)
+	{
+		const char* p = data.data();
+		const char* end = p + data.size();
+		while (p < end)
+		{
+			const int sent = send(s, p, static_cast<int>(end - p), 0);
+			Check(sent > 0, "Failed to send the requests");
+			p += sent;
+		}
+	}
+
+	std::string ReceiveAll(tSocket s)
+	{
+		std::string data;
+		char buffer[16 * 1024];
+		int received;
+		while ((received = recv(s, buffer, static_cast<int>(sizeof(buffer)), 0)) > 0)
+		{
+			data.append(buffer, received);
+		}
+		return data;
+	}
+
+	// A client that sends all its requests and then closes its side of the connection must still get every response
+	void TestServerPipelinedRequestsThenHalfClose()
+	{
+		const fs::path socketPath = fs::temp_directory_path() / ("v-fxc-tests-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".sock");
+
+		// Listen never returns, the server is left running until the process exits
+		CCompileServer* server = new CCompileServer(1, nullptr);
+		std::thread([server, socketPath]() { server->Listen(socketPath); }).detach();
+
+		// the inputs don't exist, so each request fails quickly without needing the D3D compiler, and the
+		// requests are all read before the single worker has answered them
+		constexpr uint32_t NumRequests = 200;
+		std::string requests;
+		for (uint32_t i = 0; i < NumRequests; i++)
+		{
+			requests += "id " + std::to_string(i) + "\nmode validate\ninput " + (fs::temp_directory_path() / "v-fxc-tests-missing.fx").string() + "\n\n";
+		}
+
+		const tSocket s = Connect(socketPath);
+		SendAll(s, requests);
+		shutdown(s, ShutdownSend);
+		const std::string responses = ReceiveAll(s);
+		CloseSocket(s);
+
+		std::error_code ec;
+		fs::remove(socketPath, ec);
+
+		std::set<std::string> ids;
+		size_t p = 0;
+		while (p < responses.size())
+		{
+			const size_t headerEnd = responses.find("\n\n", p);
+			Check(headerEnd != std::string::npos, "Truncated response header");
+			const std::string header = responses.substr(p, headerEnd - p);
+
+			const size_t id = header.find("id ");
+			const size_t size = header.find("size ");
+			Check(id == 0 && size != std::string::npos, "Invalid response header '" + header + "'");
+			ids.insert(header.substr(3, header.find('\n') - 3));
+			p = headerEnd + 2 + std::stoull(header.substr(size + 5));
+		}
+
+		Check(ids.size() == NumRequests, "Received " + std::to_string(ids.size()) + " responses out of " + std::to_string(NumRequests));
+	}
+
+	// A source size above the maximum is rejected before anything is allocated for it
+	void TestServerRejectsSourceAboveMaximumSize()
+	{
+		CCompileServer server(1, nullptr);
+		std::istringstream in("id big\ninput effect.fx\nsource " + std::to_string(CCompileServer::MaxSourceSize + 1) + "\n\n");
+		std::ostringstream out;
+		server.Serve(in, out);
+
+		const std::string response = out.str();
+		Check(response.find("id big\nstatus error\n") == 0 && response.find("Invalid request: Source size") != std::string::npos,
+			"Unexpected response '" + response + "'");
+	}
+
+	uint64_t GetDirectorySize(const fs::path& directory)
+	{
+		uint64_t size = 0;
+		std::error_code ec;
+		for (auto it = fs::recursive_directory_iterator(directory, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+		{
+			std::error_code entryEc;
+			if (it->is_regular_file(entryEc))
+			{
+				size += it->file_size(entryEc);
+			}
+		}
+		return size;
+	}
+
+	// A server that keeps running must not let its cache grow past the maximum size
+	void TestServerTrimsCacheAfterConnection()
+	{
+		const std::string name = "v-fxc-tests-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+		const fs::path directory = fs::temp_directory_path() / (name + "-cache");
+		const fs::path socketPath = fs::temp_directory_path() / (name + ".sock");
+
+		constexpr uint64_t MaxSize = 4096;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			const fs::path entryPath = directory / "00" / ("00000000000000" + std::to_string(10 + i) + ".bin");
+			fs::create_directories(entryPath.parent_path());
+			std::ofstream(entryPath, std::ios::binary) << std::string(1024, 'x');
+		}
+
+		// Listen never returns, the server and its cache are left running until the process exits
+		CCodeCache* cache = new CCodeCache(directory, MaxSize);
+		CCompileServer* server = new CCompileServer(1, cache);
+		std::thread([server, socketPath]() { server->Listen(socketPath); }).detach();
+
+		const tSocket s = Connect(socketPath);
+		shutdown(s, ShutdownSend);
+		ReceiveAll(s);
+		CloseSocket(s);
+
+		// the connection is trimmed after it is closed, on the server side
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (GetDirectorySize(directory) > MaxSize && std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		const uint64_t size = GetDirectorySize(directory);
+
+		std::error_code ec;
+		fs::remove(socketPath, ec);
+		fs::remove_all(directory, ec);
+
+		Check(size <= MaxSize, "Cache size " + std::to_string(size) + " above the maximum size " + std::to_string(MaxSize));
+	}
+
+	// The programs whose code wasn't set are compiled, the others are kept
+	void TestEffectCompilesOnlyMissingPrograms()
+	{
+		const std::string source = "technique t { pass { VertexShader = VS_Main; PixelShader = PS_Main; } }";
+		const uint8_t program[] = { 1, 2, 3, 4 };
+
+		CEffect partial("", "effect.fx", {}, sEffectOptions());
+		partial.SetPreprocessedSource(source);
+		partial.SetProgramCode("VS_Main", std::make_unique<CCodeBlob>(program, static_cast<uint32_t>(sizeof(program))));
+		bool compiled = false;
+		try
+		{
+			// PS_Main doesn't exist in the source, or there is no D3D compiler, either way compiling it fails
+			partial.EnsureProgramsCode();
+		}
+		catch (const std::exception&)
+		{
+			compiled = true;
+		}
+		Check(compiled, "The program without code was not compiled");
+
+		CEffect complete("", "effect.fx", {}, sEffectOptions());
+		complete.SetPreprocessedSource(source);
+		complete.SetProgramCode("VS_Main", std::make_unique<CCodeBlob>(program, static_cast<uint32_t>(sizeof(program))));
+		complete.SetProgramCode("PS_Main", std::make_unique<CCodeBlob>(program, static_cast<uint32_t>(sizeof(program))));
+		complete.EnsureProgramsCode();
+		Check(complete.GetProgramCode("PS_Main").Size() == sizeof(program), "The code set was replaced");
+	}
+
+	// A source that is empty once preprocessed is not preprocessed again
+	void TestEffectEmptyPreprocessedSourceIsKept()
+	{
+		// preprocessing this source fails, with or without the D3D compiler
+		CEffect effect("#error preprocessed again", "effect.fx", {}, sEffectOptions());
+		effect.SetPreprocessedSource("");
+		effect.EnsureTechniques();
+		effect.EnsureProgramsCode();
+		Check(effect.Techniques().empty(), "Techniques found in an empty source");
+	}
+
+	// An error in a chunk parsed in parallel is reported at the same position as when parsing the source whole
+	void TestEffectParserParallelErrorPosition()
+	{
+		std::string source;
+		for (uint32_t i = 0; source.size() < 4 * CEffectParser::MinChunkSize; i++)
+		{
+			source += "float4 gValue" + std::to_string(i) + ";\n";
+		}
+		source += "technique t { pass { VertexShader = ; } }\n";
+
+		std::string errors[2];
+		const uint32_t numJobs[2] = { 1, 4 };
+		for (size_t i = 0; i < 2; i++)
+		{
+			try
+			{
+				CEffectParser(source).Parse(numJobs[i]);
+			}
+			catch (const std::exception& e)
+			{
+				errors[i] = e.what();
+			}
+		}
+
+		Check(!errors[0].empty(), "The invalid source was parsed");
+		Check(errors[0] == errors[1], "Error '" + errors[1] + "' parsing in parallel, expected '" + errors[0] + "'");
+	}
+
+	// An entry with the same hash but stored for different inputs must not be returned
+	void TestCodeCacheHashCollisionIsAMiss()
+	{
+		const fs::path directory = fs::temp_directory_path() / ("v-fxc-tests-cache-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+		const sCodeCacheKey key = CCodeCache::ComputeKey(CCodeCache::HashSource("float4 main() : SV_Target { return 0; }"), "main", "ps_4_0", 0, "test");
+		sCodeCacheKey collidingKey = CCodeCache::ComputeKey(CCodeCache::HashSource("float4 main() : SV_Target { return 1; }"), "main", "ps_4_0", 0, "test");
+		collidingKey.Hash = key.Hash;
+
+		const uint8_t program[] = { 1, 2, 3, 4 };
+		{
+			CCodeCache cache(directory, 0);
+			cache.Insert(key, CCodeBlob(program, sizeof(program)));
+		}
+
+		for (bool keepInMemory : { false, true })
+		{
+			CCodeCache cache(directory, 0, keepInMemory);
+			Check(cache.Find(collidingKey) == nullptr, "Found an entry stored for different inputs");
+			const std::unique_ptr<CCodeBlob> code = cache.Find(key);
+			Check(code && code->Size() == sizeof(program), "Entry not found");
+			Check(cache.Find(collidingKey) == nullptr, "Found an entry stored for different inputs in memory");
+		}
+
+		std::error_code ec;
+		fs::remove_all(directory, ec);
+	}
+}
+
+int main()
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		std::cerr << "Failed to initialize Winsock\n";
+		return EXIT_FAILURE;
+	}
+#endif
+
+	const std::pair<const char*, std::function<void()>> tests[] =
+	{
+		{ "server/pipelined_requests_then_half_close", TestServerPipelinedRequestsThenHalfClose },
+		{ "server/trims_cache_after_connection", TestServerTrimsCacheAfterConnection },
+		{ "server/rejects_source_above_maximum_size", TestServerRejectsSourceAboveMaximumSize },
+		{ "effect_parser/parallel_error_position", TestEffectParserParallelErrorPosition },
+		{ "code_cache/hash_collision_is_a_miss", TestCodeCacheHashCollisionIsAMiss },
+		{ "effect/compiles_only_missing_programs", TestEffectCompilesOnlyMissingPrograms },
+		{ "effect/empty_preprocessed_source_is_kept", TestEffectEmptyPreprocessedSourceIsKept },
+	};
+
+	int failed = 0;
+	for (const auto& [name, test] : tests)
+	{
+		try
+		{
+			test();
+			std::cout << "ok      " << name << "\n";
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "FAILED  " << name << ": " << e.what() << "\n";
+			failed++;
+		}
+	}
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}